@@ -0,0 +1,388 @@
+// Throughput of every block, swept over chunk sizes, tap counts and FFT sizes. The results are printed as JSON on stdout, progress goes to stderr.
+// Rates are per input sample, except for the modulators, oscillators and constellation mappers where they are per output sample.
+//
+// g++ -std=c++17 -O3 -march=native -I.. benchmark.cpp -o benchmark -lvolk -lfftw3f -lpthread
+// ./benchmark [--min-time seconds] [--filter name] > results.json
+#include "../dsp/channelizer.h"
+#include "../dsp/constellation.h"
+#include "../dsp/convert.h"
+#include "../dsp/demodulator.h"
+#include "../dsp/fft.h"
+#include "../dsp/fftfilters.h"
+#include "../dsp/firfilters.h"
+#include "../dsp/gain.h"
+#include "../dsp/mixer.h"
+#include "../dsp/modulator.h"
+#include "../dsp/nco.h"
+#include "../dsp/resamplers.h"
+#include "../dsp/timing.h"
+#include "../dsp/vco.h"
+#include <chrono>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace {
+    struct result {
+        std::string block;
+        std::string type;
+        int taps;
+        int chunk;
+        int fftSize;
+        long long calls;
+        double msps;
+        double nsPerSample;
+    };
+
+    double minTime = 0.25;
+    const char *filter = nullptr;
+    std::vector<result> results;
+
+    // Calls func until minTime has passed, func returns the amount of samples it processed
+    void measure(const char *block, const char *type, int taps, int chunk, int fftSize, std::function<int()> func) {
+        if (filter != nullptr && strstr(block, filter) == nullptr) {
+            return;
+        }
+        func(); // warmup, also builds FFTW plans
+
+        auto start = std::chrono::steady_clock::now();
+        double elapsed = 0;
+        long long calls = 0;
+        double samples = 0;
+        while (elapsed < minTime) {
+            samples += func();
+            calls++;
+            elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        result r = {block, type, taps, chunk, fftSize, calls, (samples / elapsed) / 1e6, (elapsed * 1e9) / samples};
+        fprintf(stderr, "%-24s %-8s taps %5d chunk %6d fft %6d: %10.2f Msps %8.3f ns/sample\n", block, type, taps, chunk, fftSize, r.msps, r.nsPerSample);
+        results.push_back(r);
+    }
+
+    std::vector<float> noise(int count) {
+        std::vector<float> v(count);
+        for (float &s : v) {
+            s = ((float)rand() / RAND_MAX) - 0.5f;
+        }
+        return v;
+    }
+
+    std::vector<std::complex<float>> cnoise(int count) {
+        std::vector<std::complex<float>> v(count);
+        for (std::complex<float> &s : v) {
+            s = {((float)rand() / RAND_MAX) - 0.5f, ((float)rand() / RAND_MAX) - 0.5f};
+        }
+        return v;
+    }
+
+    std::vector<char> bytes(int count) {
+        std::vector<char> v(count);
+        for (char &b : v) {
+            b = rand();
+        }
+        return v;
+    }
+
+    std::vector<float> lowpass(int taps, float cutoff) {
+        return dsp::filters::FIRcoeffcalc::calcCoeffs(dsp::filters::FIRcoeffcalc::lowpass, taps, 2, cutoff);
+    }
+
+    const int chunks[] = {256, 4096, 65536};
+    const int tapCounts[] = {15, 63, 255};
+    const int fftSizes[] = {256, 1024, 4096, 16384, 65536};
+
+    void benchFilters() {
+        for (int chunk : chunks) {
+            std::vector<float> rin = noise(chunk);
+            std::vector<std::complex<float>> cin = cnoise(chunk);
+            std::vector<float> rout(chunk);
+            std::vector<std::complex<float>> cout(chunk);
+
+            for (int taps : tapCounts) {
+                dsp::filters::FIR<float> rfir(lowpass(taps, 0.25), chunk);
+                measure("FIR", "float", taps, chunk, 0, [&]() { rfir.run(rin.data(), rout.data(), chunk); return chunk; });
+
+                dsp::filters::FIR<std::complex<float>> cfir(lowpass(taps, 0.25), chunk);
+                measure("FIR", "complex", taps, chunk, 0, [&]() { cfir.run(cin.data(), cout.data(), chunk); return chunk; });
+
+                dsp::filters::hilbertFIR hilbert(taps, chunk);
+                measure("hilbertFIR", "float", taps, chunk, 0, [&]() { hilbert.processSamples(chunk, rin.data(), cout.data()); return chunk; });
+            }
+
+            for (int taps : {63, 255, 1023}) {
+                dsp::filters::fftFIRfilter<float> rfft(lowpass(taps, 0.25), chunk);
+                measure("fftFIRfilter", "float", taps, chunk, 0, [&]() { rfft.run(rin.data(), rout.data(), chunk); return chunk; });
+
+                dsp::filters::fftFIRfilter<std::complex<float>> cfft(lowpass(taps, 0.25), chunk);
+                measure("fftFIRfilter", "complex", taps, chunk, 0, [&]() { cfft.run(cin.data(), cout.data(), chunk); return chunk; });
+            }
+
+            // O(taps log taps) per sample, only the small sizes are worth running
+            if (chunk <= 4096) {
+                for (int taps : {64, 256}) {
+                    dsp::filters::fftbrickwallhilbert brickwall(taps, chunk);
+                    measure("fftbrickwallhilbert", "float", taps, chunk, 0, [&]() { brickwall.processSamples(chunk, rin.data(), cout.data()); return chunk; });
+                }
+            }
+        }
+    }
+
+    void benchResamplers() {
+        for (int chunk : chunks) {
+            std::vector<std::complex<float>> cin = cnoise(chunk);
+            std::vector<std::complex<float>> cout(chunk * 4);
+
+            for (int taps : tapCounts) {
+                dsp::resamplers::interpolator<std::complex<float>> interp(lowpass(taps * 4, 0.125), 4, chunk);
+                measure("interpolator", "complex", taps * 4, chunk, 0, [&]() { interp.process(cin.data(), cout.data(), chunk); return chunk; });
+
+                dsp::resamplers::decimator<std::complex<float>> decim(lowpass(taps * 4, 0.125), 4, chunk);
+                measure("decimator", "complex", taps * 4, chunk, 0, [&]() { decim.process(cin.data(), cout.data(), chunk); return chunk; });
+
+                dsp::resamplers::PSK_PulseShaping_CCRationalResamplerBlock psk(taps * 4, 4, 0.35, chunk);
+                measure("PSK_PulseShaping", "complex", taps * 4, chunk, 0, [&]() { psk.process(cin.data(), cout.data(), chunk); return chunk; });
+            }
+
+            std::vector<float> rin = noise(chunk);
+            std::vector<float> rout(chunk * 4);
+
+            dsp::resamplers::realUpsampler rup(chunk, 4, 63);
+            measure("realUpsampler", "float", 63, chunk, 0, [&]() { rup.upsample(chunk, rin.data(), rout.data()); return chunk; });
+
+            dsp::resamplers::complexUpsampler cup(chunk, 4, 63);
+            measure("complexUpsampler", "complex", 63, chunk, 0, [&]() { cup.processSamples(cin.data(), cout.data()); return chunk; });
+
+            dsp::resamplers::realDownsampler rdown(4);
+            measure("realDownsampler", "float", 0, chunk, 0, [&]() { rdown.downsample(chunk, rin.data(), rout.data()); return chunk; });
+
+            dsp::resamplers::realDownsampler rdownFiltered(chunk, 4, 63);
+            measure("realDownsampler", "float", 63, chunk, 0, [&]() { rdownFiltered.downsample(chunk, rin.data(), rout.data()); return chunk; });
+
+            // Tap counts are per cascade, the sum over all stages. The CIC has none, its rate is in the name
+            for (int factor : {4, 16}) {
+                dsp::resamplers::halfbandDecimatorCascade<std::complex<float>> hbDecim(factor, 0.8, 80, chunk);
+                std::vector<std::complex<float>> hbOut(chunk * factor);
+                int hbTaps = 0;
+                for (std::vector<float> &stage : dsp::resamplers::halfbandCascadeTaps(factor, 0.8, 80)) {
+                    hbTaps += stage.size();
+                }
+                measure("halfbandDecimatorCascade", "complex", hbTaps, chunk, 0, [&]() { hbDecim.process(cin.data(), hbOut.data(), chunk); return chunk; });
+
+                dsp::resamplers::halfbandInterpolatorCascade<std::complex<float>> hbInterp(factor, 0.8, 80, chunk);
+                measure("halfbandInterpolatorCascade", "complex", hbTaps, chunk, 0, [&]() { hbInterp.process(cin.data(), hbOut.data(), chunk); return chunk; });
+
+                std::string rate = "_x" + std::to_string(factor);
+                dsp::resamplers::cicDecimator<std::complex<float>> cicDecim(factor, 4);
+                measure(("cicDecimator" + rate).c_str(), "complex", 0, chunk, 0, [&]() { cicDecim.process(cin.data(), hbOut.data(), chunk); return chunk; });
+
+                dsp::resamplers::cicInterpolator<std::complex<float>> cicInterp(factor, 4);
+                measure(("cicInterpolator" + rate).c_str(), "complex", 0, chunk, 0, [&]() { cicInterp.process(cin.data(), hbOut.data(), chunk); return chunk; });
+            }
+
+            for (int channels : {16, 64}) {
+                dsp::channelizer::pfbChannelizer channelizer(channels, 16, chunk);
+                std::vector<std::complex<float>> channelOut(chunk);
+                std::vector<std::complex<float> *> outs(channels);
+                for (int i = 0; i < channels; i++) {
+                    outs[i] = &channelOut[i * (chunk / channels)];
+                }
+                measure("pfbChannelizer", "complex", channels * 16, chunk, 0, [&]() { channelizer.process(cin.data(), chunk, outs.data()); return chunk; });
+            }
+        }
+    }
+
+    void benchSpectrum() {
+        for (int N : fftSizes) {
+            std::vector<std::complex<float>> cin = cnoise(N);
+            std::vector<float> rin = noise(N);
+            std::vector<float> out(N);
+
+            dsp::fft::complexPowerSpectrum cps(N);
+            measure("complexPowerSpectrum", "complex", 0, N, N, [&]() { cps.processFFT(cin.data(), out.data()); return N; });
+
+            dsp::fft::realPowerSpectrum rps(N);
+            measure("realPowerSpectrum", "float", 0, N, N, [&]() { rps.processFFT(rin.data(), out.data()); return N; });
+
+            int chunk = 65536;
+            std::vector<std::complex<float>> win = cnoise(chunk);
+            dsp::fft::welchPowerSpectrum welch(N, N / 2, dsp::fft::welchPowerSpectrum::linear);
+            measure("welchPowerSpectrum", "complex", 0, chunk, N, [&]() { welch.process(win.data(), chunk); return chunk; });
+        }
+    }
+
+    void benchGainAndMixers() {
+        for (int chunk : chunks) {
+            std::vector<float> rin = noise(chunk);
+            std::vector<std::complex<float>> cin = cnoise(chunk);
+            std::vector<float> rout(chunk);
+            std::vector<std::complex<float>> cout(chunk);
+
+            dsp::gain::agc agc(10, 48000, 1);
+            measure("agc", "float", 0, chunk, 0, [&]() { agc.process(rin.data(), rout.data(), chunk); return chunk; });
+
+            dsp::gain::ragc ragc(0.001, 0.1, 48000, 1);
+            measure("ragc", "float", 0, chunk, 0, [&]() { ragc.process(rin.data(), rout.data(), chunk); return chunk; });
+
+            dsp::gain::cagc cagc(0.001, 0.1, 48000, 1);
+            measure("cagc", "complex", 0, chunk, 0, [&]() { cagc.process(cin.data(), cout.data(), chunk); return chunk; });
+
+            dsp::mixer::real_mixer rmix(1000, 48000);
+            measure("real_mixer", "float", 0, chunk, 0, [&]() { rmix.run(rout.data(), rin.data(), chunk); return chunk; });
+
+            dsp::mixer::complex_mixer cmix(1000, 48000);
+            measure("complex_mixer", "complex", 0, chunk, 0, [&]() { cmix.run(cout.data(), cin.data(), chunk); return chunk; });
+        }
+    }
+
+    void benchOscillators() {
+        for (int chunk : chunks) {
+            std::vector<float> control = noise(chunk);
+            std::vector<float> rout(chunk);
+            std::vector<std::complex<float>> cout(chunk);
+
+            dsp::vco::rvco rvco(1000, 48000);
+            measure("rvco", "float", 0, chunk, 0, [&]() { rvco.process(control.data(), rout.data(), chunk); return chunk; });
+
+            dsp::vco::cvco cvco(1000, 48000);
+            measure("cvco", "complex", 0, chunk, 0, [&]() { cvco.process(control.data(), cout.data(), chunk); return chunk; });
+
+            dsp::nco::nco nco(1000, 48000);
+            measure("nco", "complex", 0, chunk, 0, [&]() { nco.generate(cout.data(), chunk); return chunk; });
+        }
+    }
+
+    void benchConvert() {
+        for (int chunk : chunks) {
+            std::vector<float> fin = noise(chunk);
+            std::vector<float> fout(chunk);
+            std::vector<int16_t> s16(chunk);
+            std::vector<uint8_t> u8(chunk);
+            std::vector<int8_t> s8(chunk);
+            dsp::convert::floatToS16(fin.data(), s16.data(), chunk);
+            dsp::convert::floatToU8(fin.data(), u8.data(), chunk);
+            dsp::convert::floatToS8(fin.data(), s8.data(), chunk);
+
+            measure("convert_u8ToFloat", "float", 0, chunk, 0, [&]() { dsp::convert::u8ToFloat(u8.data(), fout.data(), chunk); return chunk; });
+            measure("convert_floatToU8", "float", 0, chunk, 0, [&]() { dsp::convert::floatToU8(fin.data(), u8.data(), chunk); return chunk; });
+            measure("convert_s8ToFloat", "float", 0, chunk, 0, [&]() { dsp::convert::s8ToFloat(s8.data(), fout.data(), chunk); return chunk; });
+            measure("convert_floatToS8", "float", 0, chunk, 0, [&]() { dsp::convert::floatToS8(fin.data(), s8.data(), chunk); return chunk; });
+            measure("convert_s16ToFloat", "float", 0, chunk, 0, [&]() { dsp::convert::s16ToFloat(s16.data(), fout.data(), chunk); return chunk; });
+            measure("convert_floatToS16", "float", 0, chunk, 0, [&]() { dsp::convert::floatToS16(fin.data(), s16.data(), chunk); return chunk; });
+        }
+    }
+
+    void benchDemodulators() {
+        for (int chunk : chunks) {
+            std::vector<std::complex<float>> cin = cnoise(chunk);
+            std::vector<float> rout(chunk);
+            std::vector<std::complex<float>> cout(chunk);
+
+            dsp::demodulator::quadratureDemod demod(1000, 48000, chunk);
+            measure("quadratureDemod", "complex", 0, chunk, 0, [&]() { demod.process(cin.data(), rout.data(), chunk); return chunk; });
+
+            dsp::demodulator::quadratureDemod demodDecim(1000, 48000, chunk, lowpass(63, 0.125), 4);
+            measure("quadratureDemod", "complex", 63, chunk, 0, [&]() { demodDecim.process(cin.data(), rout.data(), chunk); return chunk; });
+
+            dsp::timing::symbolSync<std::complex<float>> gardner(dsp::timing::gardner, 4, 0.35, 41, 32, 0.01, chunk);
+            measure("symbolSync_gardner", "complex", 41, chunk, 0, [&]() { gardner.process(cin.data(), cout.data(), chunk); return chunk; });
+
+            dsp::timing::symbolSync<std::complex<float>> mm(dsp::timing::muellerMuller, 4, 0.35, 41, 32, 0.01, chunk);
+            measure("symbolSync_mm", "complex", 41, chunk, 0, [&]() { mm.process(cin.data(), cout.data(), chunk); return chunk; });
+        }
+    }
+
+    void benchModulators() {
+        for (int chunk : chunks) {
+            // Enough input bytes for about chunk output samples at 8 samples per symbol, QPSK only carries 2 bits per symbol so it gets twice as many
+            int inBytes = std::max(chunk / 64, 1);
+            std::vector<char> in = bytes(inBytes * 2);
+
+            dsp::modulator::r2FSKmodulator fsk(1200, 2200, 6000, 48000);
+            std::vector<float> rout(fsk.calcOutSamples(inBytes));
+            measure("r2FSKmodulator", "float", 0, chunk, 0, [&]() { fsk.process(in.data(), inBytes, rout.data()); return fsk.calcOutSamples(inBytes); });
+
+            dsp::modulator::rFSKvcogen vcogen(6000, 48000);
+            measure("rFSKvcogen", "float", 0, chunk, 0, [&]() { vcogen.process(in.data(), inBytes, rout.data()); return vcogen.calcOutSamples(inBytes); });
+
+            dsp::modulator::cpfskModulator cpfsk(2, 1000, 0, 6000, 48000);
+            std::vector<std::complex<float>> cout(cpfsk.calcOutSamples(inBytes) * 2);
+            measure("cpfskModulator", "complex", 0, chunk, 0, [&]() { return cpfsk.process(in.data(), inBytes, cout.data()); });
+
+            dsp::modulator::cpfskModulator gfsk(2, 1000, 0, 6000, 48000, 0.5, 3);
+            measure("cpfskModulator_gfsk", "complex", 0, chunk, 0, [&]() { return gfsk.process(in.data(), inBytes, cout.data()); });
+
+            dsp::modulator::cQPSKmodulator qpsk(12000, 48000);
+            cout.resize(std::max<size_t>(cout.size(), qpsk.calcOutSamples(inBytes * 2)));
+            measure("cQPSKmodulator", "complex", 0, chunk, 0, [&]() { qpsk.process(in.data(), inBytes * 2, cout.data()); return qpsk.calcOutSamples(inBytes * 2); });
+
+            dsp::modulator::cQPSKRRCmodulator rrc(4, 0.35, 65, inBytes * 2);
+            cout.resize(std::max<size_t>(cout.size(), rrc.calcOutSamples(inBytes * 2)));
+            measure("cQPSKRRCmodulator", "complex", 65, chunk, 0, [&]() { rrc.process(in.data(), inBytes * 2, cout.data()); return rrc.calcOutSamples(inBytes * 2); });
+        }
+    }
+
+    template <class CONSTELLATION>
+    void benchMapper(const char *name, bool differential) {
+        for (int chunk : chunks) {
+            dsp::constellation::mapper<CONSTELLATION> mapper(differential);
+            std::vector<char> in = bytes(chunk);
+            std::vector<std::complex<float>> out(mapper.calcOutSymbols(chunk));
+            measure(name, "complex", 0, chunk, 0, [&]() { return mapper.process(in.data(), chunk, out.data()); });
+        }
+    }
+
+    void benchMappers() {
+        benchMapper<dsp::constellation::qpsk>("mapper_qpsk", false);
+        benchMapper<dsp::constellation::qpsk>("mapper_qpsk_differential", true);
+        benchMapper<dsp::constellation::psk8>("mapper_psk8", false);
+        benchMapper<dsp::constellation::qam16>("mapper_qam16", false);
+        benchMapper<dsp::constellation::qam64>("mapper_qam64", false);
+    }
+
+    void printJSON() {
+        printf("{\n");
+        printf("  \"fftw\": \"%s\",\n", fftwf_version);
+        printf("  \"compiler\": \"%s\",\n", __VERSION__);
+        printf("  \"min_time\": %g,\n", minTime);
+        printf("  \"results\": [\n");
+        for (size_t i = 0; i < results.size(); i++) {
+            const result &r = results[i];
+            printf("    {\"block\": \"%s\", \"type\": \"%s\", \"taps\": %d, \"chunk\": %d, \"fft_size\": %d, \"calls\": %lld, \"msps\": %.4f, \"ns_per_sample\": %.4f}%s\n",
+                   r.block.c_str(), r.type.c_str(), r.taps, r.chunk, r.fftSize, r.calls, r.msps, r.nsPerSample, (i + 1) < results.size() ? "," : "");
+        }
+        printf("  ]\n");
+        printf("}\n");
+    }
+}
+
+int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--min-time") && (i + 1) < argc) {
+            minTime = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--filter") && (i + 1) < argc) {
+            filter = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--min-time seconds] [--filter name]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    srand(1);
+    benchFilters();
+    benchResamplers();
+    benchSpectrum();
+    benchGainAndMixers();
+    benchOscillators();
+    benchConvert();
+    benchDemodulators();
+    benchModulators();
+    benchMappers();
+
+    printJSON();
+    return 0;
+}
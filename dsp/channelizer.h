@@ -0,0 +1,148 @@
+#pragma once
+#include "fftplan.h"
+#include "firfilters.h"
+#include "instrumentation.h"
+#include <cassert>
+#include <complex>
+#include <cstring>
+#include <fftw3.h>
+#include <vector>
+#include <volk/volk.h>
+
+namespace dsp::channelizer {
+    // Critically sampled polyphase filter bank. Splits the input into M channels of samplerate / M, channel k is centered on
+    // k * samplerate / M (the upper half are the negative frequencies). Costs one FIR of the prototype length plus one M-point FFT per M input samples
+    class pfbChannelizer {
+    public:
+        // Prototype lowpass from FIRcoeffcalc with the cutoff on the channel edge
+        pfbChannelizer(int channels, int tapsPerChannel, int maxInputSamples)
+            : pfbChannelizer(channels, filters::FIRcoeffcalc::calcCoeffs(filters::FIRcoeffcalc::lowpass, channels * tapsPerChannel, channels * 2, 1), maxInputSamples) {}
+
+        pfbChannelizer(int channels, std::vector<float> prototype, int maxInputSamples) {
+            M = channels;
+            P = (prototype.size() + M - 1) / M;
+            maxBlocks = maxInputSamples / M;
+            stride = (P - 1) + maxBlocks;
+
+            // Unity gain in every channel
+            float sum = 0;
+            for (float t : prototype) {
+                sum += t;
+            }
+
+            int align = volk_get_alignment();
+
+            // Branch p gets every Mth tap starting at p, reversed for the dot product
+            subtaps = (float *)volk_malloc(M * P * sizeof(float), align);
+            std::fill(subtaps, &subtaps[M * P], 0);
+            for (size_t i = 0; i < prototype.size(); i++) {
+                subtaps[((i % M) * P) + (P - 1) - (i / M)] = prototype[i] / sum;
+            }
+
+            branches = (std::complex<float> *)volk_malloc(M * stride * sizeof(std::complex<float>), align);
+            std::fill(branches, &branches[M * stride], 0);
+
+            fft_in = (std::complex<float> *)fftwf_malloc(sizeof(std::complex<float>) * M);
+            fft_out = (std::complex<float> *)fftwf_malloc(sizeof(std::complex<float>) * M);
+            plan = fft::planCache::get().getPlan(fft::planCache::c2c_backward, M);
+
+            std::vector<int> all(M);
+            for (int i = 0; i < M; i++) {
+                all[i] = i;
+            }
+            selectChannels(all);
+        }
+
+        ~pfbChannelizer() {
+            volk_free(subtaps);
+            volk_free(branches);
+            if (twiddles != nullptr) {
+                volk_free(twiddles);
+            }
+            fftwf_free(fft_in);
+            fftwf_free(fft_out);
+        }
+
+        int getChannelCount() {
+            return M;
+        }
+
+        // Only these channels are written to the output, in this order. Every index has to be below the channel count
+        void selectChannels(std::vector<int> channels) {
+            for (int ch : channels) {
+                assert(ch >= 0 && ch < M);
+            }
+            selected = channels;
+
+            // For a handful of channels computing their DFT bins directly is cheaper than the whole FFT
+            useFFT = (selected.size() * M * 8.0) > (5.0 * M * log2(M));
+            if (twiddles != nullptr) {
+                volk_free(twiddles);
+                twiddles = nullptr;
+            }
+            if (!useFFT) {
+                twiddles = (std::complex<float> *)volk_malloc(selected.size() * M * sizeof(std::complex<float>), volk_get_alignment());
+                for (size_t c = 0; c < selected.size(); c++) {
+                    for (int p = 0; p < M; p++) {
+                        double angle = (2 * M_PI * (((int64_t)selected[c] * p) % M)) / M;
+                        twiddles[(c * M) + p] = {(float)cos(angle), (float)sin(angle)};
+                    }
+                }
+            }
+        }
+
+        // count has to be a multiple of the channel count, out[i] receives count / M samples of the ith selected channel. Returns the samples per channel
+        int process(std::complex<float> *in, int count, std::complex<float> **out) {
+            DSP_INSTRUMENT("channelizer::pfbChannelizer", count);
+            // A partial block would leave the commutator out of step with the stream on the next call
+            assert(count % M == 0 && count / M <= maxBlocks);
+            int blocks = count / M;
+
+            // Commutator, the newest sample of every block goes to branch 0
+            for (int m = 0; m < blocks; m++) {
+                for (int i = 0; i < M; i++) {
+                    branches[(((M - 1) - i) * stride) + (P - 1) + m] = in[(m * M) + i];
+                }
+            }
+
+            for (int m = 0; m < blocks; m++) {
+                for (int p = 0; p < M; p++) {
+                    filters::dotProduct(&fft_in[p], &branches[(p * stride) + m], &subtaps[p * P], P);
+                }
+                if (useFFT) {
+                    fftwf_execute_dft(plan, (fftwf_complex *)fft_in, (fftwf_complex *)fft_out);
+                    for (size_t c = 0; c < selected.size(); c++) {
+                        out[c][m] = fft_out[selected[c]];
+                    }
+                } else {
+                    for (size_t c = 0; c < selected.size(); c++) {
+                        filters::dotProduct(&out[c][m], fft_in, &twiddles[c * M], M);
+                    }
+                }
+            }
+
+            for (int p = 0; p < M; p++) {
+                memmove(&branches[p * stride], &branches[(p * stride) + blocks], (P - 1) * sizeof(std::complex<float>));
+            }
+
+            return blocks;
+        }
+
+    private:
+        int M; // channels
+        int P; // taps per branch
+        int maxBlocks;
+        int stride;
+
+        float *subtaps;
+        std::complex<float> *branches;
+
+        std::vector<int> selected;
+        bool useFFT;
+        std::complex<float> *twiddles = nullptr;
+
+        std::complex<float> *fft_in;
+        std::complex<float> *fft_out;
+        fftwf_plan plan;
+    };
+}
@@ -0,0 +1,174 @@
+#pragma once
+#include <array>
+#include <complex>
+#include <cstring>
+
+// Constellations with their point tables generated at compile time, and a mapper that turns packed bytes into symbols with table lookups.
+// Bits are taken LSB first, same as the existing modulators
+namespace dsp::constellation {
+    constexpr double constexprPi = 3.14159265358979323846;
+
+    // Taylor series, only used to build tables at compile time
+    constexpr double constexprSin(double x) {
+        while (x > constexprPi) {
+            x -= 2 * constexprPi;
+        }
+        while (x < -constexprPi) {
+            x += 2 * constexprPi;
+        }
+        double term = x;
+        double sum = x;
+        for (int n = 1; n < 20; n++) {
+            term *= -(x * x) / ((2 * n) * ((2 * n) + 1));
+            sum += term;
+        }
+        return sum;
+    }
+
+    constexpr double constexprCos(double x) {
+        return constexprSin(x + (constexprPi / 2));
+    }
+
+    constexpr double constexprSqrt(double x) {
+        double r = x > 1 ? x : 1;
+        for (int i = 0; i < 64; i++) {
+            r = 0.5 * (r + (x / r));
+        }
+        return r;
+    }
+
+    constexpr int log2Int(int x) {
+        int bits = 0;
+        while ((1 << bits) < x) {
+            bits++;
+        }
+        return bits;
+    }
+
+    constexpr int grayDecode(int g) {
+        int v = g;
+        while (g >>= 1) {
+            v ^= g;
+        }
+        return v;
+    }
+
+    // Symbol value k sits at offsetDegrees + 360 * k / M. With gray the bits are gray decoded first, so neighbouring points differ in one bit
+    template <int M, int offsetDegrees = 0, bool gray = false>
+    struct psk {
+        static_assert(M > 1 && (M & (M - 1)) == 0, "PSK order has to be a power of two");
+        static constexpr int points = M;
+        static constexpr int bitsPerSymbol = log2Int(M);
+
+        static constexpr std::array<std::complex<float>, M> makeTable() {
+            std::array<std::complex<float>, M> table{};
+            for (int i = 0; i < M; i++) {
+                int k = gray ? grayDecode(i) : i;
+                double angle = ((offsetDegrees * constexprPi) / 180) + ((2 * constexprPi * k) / M);
+                table[i] = std::complex<float>(constexprCos(angle), constexprSin(angle));
+            }
+            return table;
+        }
+
+        static constexpr std::array<std::complex<float>, M> table = makeTable();
+    };
+
+    // Square QAM normalized to unit average power. The low half of the bits picks the I level, the high half the Q level, both gray coded
+    template <int M>
+    struct qam {
+        static_assert(M > 1 && (M & (M - 1)) == 0 && (log2Int(M) % 2) == 0, "square QAM order has to be an even power of two");
+        static constexpr int points = M;
+        static constexpr int bitsPerSymbol = log2Int(M);
+        static constexpr int levels = 1 << (bitsPerSymbol / 2);
+
+        static constexpr std::array<std::complex<float>, M> makeTable() {
+            std::array<std::complex<float>, M> table{};
+            double norm = constexprSqrt((2.0 * (M - 1)) / 3.0);
+            for (int i = 0; i < M; i++) {
+                int li = grayDecode(i & (levels - 1));
+                int lq = grayDecode(i >> (bitsPerSymbol / 2));
+                table[i] = std::complex<float>(((2 * li) - (levels - 1)) / norm, ((2 * lq) - (levels - 1)) / norm);
+            }
+            return table;
+        }
+
+        static constexpr std::array<std::complex<float>, M> table = makeTable();
+    };
+
+    using bpsk = psk<2>;
+    using qpsk = psk<4, 45, true>;
+    using psk8 = psk<8, 0, true>;
+    using qam16 = qam<16>;
+    using qam64 = qam<64>;
+
+    // For bit counts that divide 8 and no differential encoding a whole byte is mapped with one lookup, otherwise symbols are
+    // gathered one by one. Bits that don't fill a whole symbol are kept for the next call.
+    // Differential encoding adds every symbol value to the previous one (mod M), which only makes sense for PSK
+    template <class CONSTELLATION>
+    class mapper {
+    public:
+        static constexpr int M = CONSTELLATION::points;
+        static_assert(M > 1 && (M & (M - 1)) == 0, "symbols are extracted by masking with M - 1, so M has to be a power of two");
+        static constexpr int bits = CONSTELLATION::bitsPerSymbol;
+        static constexpr bool byteAligned = (8 % bits) == 0;
+        static constexpr int symbolsPerByte = byteAligned ? 8 / bits : 1;
+
+        mapper(bool differential = false) {
+            _differential = differential;
+        }
+
+        ~mapper() {}
+
+        // Upper bound
+        int calcOutSymbols(int inCount) {
+            return ((inCount * 8) + bits - 1) / bits;
+        }
+
+        // Returns the amount of symbols written
+        int process(const char *in, int inCount, std::complex<float> *out) {
+            if constexpr (byteAligned) {
+                if (!_differential) {
+                    for (int i = 0; i < inCount; i++) {
+                        memcpy(&out[i * symbolsPerByte], byteTable[(unsigned char)in[i]].data(), symbolsPerByte * sizeof(std::complex<float>));
+                    }
+                    return inCount * symbolsPerByte;
+                }
+            }
+
+            int outc = 0;
+            for (int i = 0; i < inCount; i++) {
+                bitBuffer |= (unsigned int)(unsigned char)in[i] << bitCount;
+                bitCount += 8;
+                while (bitCount >= bits) {
+                    unsigned int value = bitBuffer & (M - 1);
+                    bitBuffer >>= bits;
+                    bitCount -= bits;
+                    if (_differential) {
+                        lastIndex = (value + lastIndex) % M;
+                        value = lastIndex;
+                    }
+                    out[outc++] = CONSTELLATION::table[value];
+                }
+            }
+            return outc;
+        }
+
+    private:
+        static constexpr std::array<std::array<std::complex<float>, symbolsPerByte>, 256> makeByteTable() {
+            std::array<std::array<std::complex<float>, symbolsPerByte>, 256> table{};
+            for (int b = 0; b < 256; b++) {
+                for (int s = 0; s < symbolsPerByte; s++) {
+                    table[b][s] = CONSTELLATION::table[(b >> (s * bits)) & (M - 1)];
+                }
+            }
+            return table;
+        }
+
+        static constexpr std::array<std::array<std::complex<float>, symbolsPerByte>, 256> byteTable = makeByteTable();
+
+        bool _differential;
+        unsigned int lastIndex = 0;
+        unsigned int bitBuffer = 0;
+        int bitCount = 0;
+    };
+}
@@ -0,0 +1,138 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <volk/volk.h>
+
+// Conversion between float and the usual SDR/WAV sample formats. IQ formats (cu8, cs8, cs16, cf32) are just interleaved values,
+// so count is the amount of values (2 per IQ sample). Both directions scale by 2^(bits - 1), so -1.0 is the most negative integer and
+// a round trip is exact. +1.0 is one LSB past the largest positive value and saturates to it
+namespace dsp::convert {
+    enum format { u8, s8, s16, s32, f32 };
+
+    inline size_t bytesPerValue(format fmt) {
+        switch (fmt) {
+        case u8:
+        case s8:
+            return 1;
+        case s16:
+            return 2;
+        case s32:
+        case f32:
+            return 4;
+        }
+        return 0;
+    }
+
+    // 8-bit WAV and rtl-sdr style cu8 are unsigned with 128 as zero
+    inline void u8ToFloat(const uint8_t *in, float *out, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            out[i] = (in[i] - 128.0f) * (1.0f / 128.0f);
+        }
+    }
+
+    inline void s8ToFloat(const int8_t *in, float *out, size_t count) {
+        volk_8i_s32f_convert_32f(out, in, 128.0f, count);
+    }
+
+    inline void s16ToFloat(const int16_t *in, float *out, size_t count) {
+        volk_16i_s32f_convert_32f(out, in, 32768.0f, count);
+    }
+
+    inline void s32ToFloat(const int32_t *in, float *out, size_t count) {
+        volk_32i_s32f_convert_32f(out, (const int32_t *)in, 2147483648.0f, count);
+    }
+
+    // The float to integer conversions saturate and work in place (in and out may be the same buffer)
+    inline void floatToU8(const float *in, uint8_t *out, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            float v = std::clamp(rintf(in[i] * 128.0f), -128.0f, 127.0f);
+            out[i] = (uint8_t)(v + 128.0f);
+        }
+    }
+
+    inline void floatToS8(const float *in, int8_t *out, size_t count) {
+        volk_32f_s32f_convert_8i(out, in, 128.0f, count);
+    }
+
+    inline void floatToS16(const float *in, int16_t *out, size_t count) {
+        volk_32f_s32f_convert_16i(out, in, 32768.0f, count);
+    }
+
+    // Not volk_32f_s32f_convert_32i, INT32_MAX isn't representable as a float so its clamp lets +1.0 through and the cast wraps
+    inline void floatToS32(const float *in, int32_t *out, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            double v = std::clamp(rint(in[i] * 2147483648.0), -2147483648.0, 2147483647.0);
+            out[i] = (int32_t)v;
+        }
+    }
+
+    inline void toFloat(format fmt, const void *in, float *out, size_t count) {
+        switch (fmt) {
+        case u8:
+            u8ToFloat((const uint8_t *)in, out, count);
+            break;
+        case s8:
+            s8ToFloat((const int8_t *)in, out, count);
+            break;
+        case s16:
+            s16ToFloat((const int16_t *)in, out, count);
+            break;
+        case s32:
+            s32ToFloat((const int32_t *)in, out, count);
+            break;
+        case f32:
+            if (in != out) {
+                memmove(out, in, count * sizeof(float));
+            }
+            break;
+        }
+    }
+
+    inline void fromFloat(format fmt, const float *in, void *out, size_t count) {
+        switch (fmt) {
+        case u8:
+            floatToU8(in, (uint8_t *)out, count);
+            break;
+        case s8:
+            floatToS8(in, (int8_t *)out, count);
+            break;
+        case s16:
+            floatToS16(in, (int16_t *)out, count);
+            break;
+        case s32:
+            floatToS32(in, (int32_t *)out, count);
+            break;
+        case f32:
+            if (in != out) {
+                memmove(out, in, count * sizeof(float));
+            }
+            break;
+        }
+    }
+
+    // WAV fmt chunk sample type (1 = PCM, 3 = float) and bit depth to format, returns false for unsupported combinations
+    inline bool fromWavFormat(uint16_t sampleType, uint16_t bitDepth, format &fmt) {
+        if (sampleType == 3 && bitDepth == 32) {
+            fmt = f32;
+            return true;
+        }
+        if (sampleType != 1) {
+            return false;
+        }
+        switch (bitDepth) {
+        case 8:
+            fmt = u8;
+            return true;
+        case 16:
+            fmt = s16;
+            return true;
+        case 32:
+            fmt = s32;
+            return true;
+        }
+        return false;
+    }
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include "instrumentation.h"
+#include "math.h"
+#include "resamplers.h"
+#include <algorithm>
+#include <complex>
+#include <cstring>
+#include <vector>
+#include <volk/volk.h>
+
+namespace dsp::demodulator {
+    // Branchless atan2, the selects compile to blends so loops over it vectorize. Max error is a few 1e-6 rad
+    inline float fastAtan2(float y, float x) {
+        float ax = fabsf(x);
+        float ay = fabsf(y);
+        float mx = fmaxf(ax, ay);
+        float mn = fminf(ax, ay);
+        float a = mn / (mx + 1e-30f);
+        float s = a * a;
+        float r = ((((((-0.01172120f * s) + 0.05265332f) * s - 0.11643287f) * s + 0.19354346f) * s - 0.33262347f) * s + 0.99997726f) * a;
+        r = ay > ax ? (FL_M_PI / 2) - r : r;
+        r = x < 0 ? FL_M_PI - r : r;
+        return copysignf(r, y);
+    }
+
+    // Quadrature discriminator: the angle of in[i] * conj(in[i - 1]) is the phase step of every sample. The output is scaled so a
+    // frequency offset of +deviation gives 1. With taps the output goes through a decimating FIR (post detection lowpass) before it's written
+    class quadratureDemod {
+    public:
+        quadratureDemod(float deviation, float samplerate, int maxInputSamples) {
+            init(deviation, samplerate, maxInputSamples);
+        }
+
+        quadratureDemod(float deviation, float samplerate, int maxInputSamples, std::vector<float> taps, int decimation) {
+            init(deviation, samplerate, maxInputSamples);
+            decim = new resamplers::decimator<float>(taps, decimation, maxInputSamples);
+            detected = (float *)volk_malloc(maxInputSamples * sizeof(float), volk_get_alignment());
+        }
+
+        ~quadratureDemod() {
+            delete decim;
+            volk_free(buffer);
+            volk_free(products);
+            volk_free(detected);
+        }
+
+        void changeDeviation(float deviation, float samplerate) {
+            gain = samplerate / (2 * FL_M_PI * deviation);
+        }
+
+        int calcOutSamples(int inCount) {
+            return decim != nullptr ? decim->calcOutSamples(inCount) : inCount;
+        }
+
+        // Returns the amount of output samples
+        int process(std::complex<float> *in, float *out, int count) {
+            DSP_INSTRUMENT("demodulator::quadratureDemod", count);
+            memcpy(&buffer[1], in, count * sizeof(std::complex<float>));
+            volk_32fc_x2_multiply_conjugate_32fc((lv_32fc_t *)products, (lv_32fc_t *)&buffer[1], (lv_32fc_t *)buffer, count);
+            buffer[0] = buffer[count];
+
+            float *res = decim != nullptr ? detected : out;
+            for (int i = 0; i < count; i++) {
+                res[i] = fastAtan2(products[i].imag(), products[i].real()) * gain;
+            }
+
+            if (decim != nullptr) {
+                return decim->process(detected, out, count);
+            }
+            return count;
+        }
+
+    private:
+        void init(float deviation, float samplerate, int maxInputSamples) {
+            changeDeviation(deviation, samplerate);
+            int align = volk_get_alignment();
+            // buffer[0] is the last sample of the previous call
+            buffer = (std::complex<float> *)volk_malloc((maxInputSamples + 1) * sizeof(std::complex<float>), align);
+            products = (std::complex<float> *)volk_malloc(maxInputSamples * sizeof(std::complex<float>), align);
+            buffer[0] = {0, 0};
+        }
+
+        float gain;
+        std::complex<float> *buffer;
+        std::complex<float> *products;
+        float *detected = nullptr;
+        resamplers::decimator<float> *decim = nullptr;
+    };
+}
@@ -1,8 +1,14 @@
 #pragma once
 
+#include "fftplan.h"
+#include "instrumentation.h"
 #include "window.h"
+#include <algorithm>
+#include <cassert>
 #include <complex>
+#include <cstring>
 #include <fftw3.h>
+#include <vector>
 #include <volk/volk.h>
 
 namespace dsp::fft {
@@ -16,19 +22,19 @@ namespace dsp::fft {
             }
             fftin = (fftwf_complex *)fftwf_malloc(sizeof(fftwf_complex) * _N);
             fftout = (fftwf_complex *)fftwf_malloc(sizeof(fftwf_complex) * _N);
-            fftplan = fftwf_plan_dft_1d(_N, fftin, fftout, FFTW_FORWARD, FFTW_ESTIMATE);
+            fftplan = planCache::get().getPlan(planCache::c2c_forward, _N);
         }
 
         ~complexPowerSpectrum() {
             fftwf_free(fftin);
             fftwf_free(fftout);
             fftwf_free(fft_window);
-            fftwf_destroy_plan(fftplan);
         }
 
         void processFFT(std::complex<float> *in, float *out) {
+            DSP_INSTRUMENT("fft::complexPowerSpectrum", _N);
             volk_32fc_32f_multiply_32fc((lv_32fc_t *)fftin, in, fft_window, _N);
-            fftwf_execute(fftplan);
+            fftwf_execute_dft(fftplan, fftin, fftout);
             volk_32fc_s32f_power_spectrum_32f(out, (lv_32fc_t *)fftout, _N, _N);
         }
 
@@ -39,4 +45,164 @@ namespace dsp::fft {
         float *fft_window;
         int _N;
     };
+
+    // Real input, only the N / 2 + 1 non-negative frequency bins are computed and returned
+    class realPowerSpectrum {
+    public:
+        realPowerSpectrum(int N) {
+            _N = N;
+            fft_window = (float *)fftwf_malloc(sizeof(float) * _N);
+            for (int i = 0; i < _N; i++) {
+                fft_window[i] = windowfunctions::blackman(i, _N - 1);
+            }
+            fftin = (float *)fftwf_malloc(sizeof(float) * _N);
+            fftout = (fftwf_complex *)fftwf_malloc(sizeof(fftwf_complex) * ((_N / 2) + 1));
+            fftplan = planCache::get().getPlan(planCache::r2c, _N);
+        }
+
+        ~realPowerSpectrum() {
+            fftwf_free(fftin);
+            fftwf_free(fftout);
+            fftwf_free(fft_window);
+        }
+
+        int getBinCount() {
+            return (_N / 2) + 1;
+        }
+
+        void processFFT(float *in, float *out) {
+            DSP_INSTRUMENT("fft::realPowerSpectrum", _N);
+            volk_32f_x2_multiply_32f(fftin, in, fft_window, _N);
+            fftwf_execute_dft_r2c(fftplan, fftin, fftout);
+            volk_32fc_s32f_power_spectrum_32f(out, (lv_32fc_t *)fftout, _N, (_N / 2) + 1);
+        }
+
+    private:
+        float *fftin;
+        fftwf_complex *fftout;
+        fftwf_plan fftplan;
+        float *fft_window;
+        int _N;
+    };
+
+    // Welch estimate, overlapping windowed frames averaged together. Up to batch frames are transformed with a single FFTW call
+    class welchPowerSpectrum {
+    public:
+        enum averaging { linear, exponential, peakHold };
+
+        // overlap in samples (0 <= overlap < N), alpha is only used for exponential averaging
+        welchPowerSpectrum(int N, int overlap, averaging mode, int batch = 8, float alpha = 0.1f) {
+            assert(overlap >= 0 && overlap < N && batch >= 1);
+            _N = N;
+            hop = N - overlap;
+            _mode = mode;
+            _batch = batch;
+            _alpha = alpha;
+
+            fft_window = (float *)fftwf_malloc(sizeof(float) * _N);
+            for (int i = 0; i < _N; i++) {
+                fft_window[i] = windowfunctions::blackman(i, _N - 1);
+            }
+            fftin = (fftwf_complex *)fftwf_malloc(sizeof(fftwf_complex) * _N * _batch);
+            fftout = (fftwf_complex *)fftwf_malloc(sizeof(fftwf_complex) * _N * _batch);
+            power = (float *)fftwf_malloc(sizeof(float) * _N * _batch);
+            accum = (float *)fftwf_malloc(sizeof(float) * _N);
+
+            // One plan per frame count so leftovers that don't fill a batch are still transformed together
+            for (int i = 1; i <= _batch; i++) {
+                plans.push_back(planCache::get().getPlan(planCache::c2c_forward, _N, i));
+            }
+
+            reset();
+        }
+
+        ~welchPowerSpectrum() {
+            fftwf_free(fft_window);
+            fftwf_free(fftin);
+            fftwf_free(fftout);
+            fftwf_free(power);
+            fftwf_free(accum);
+        }
+
+        void reset() {
+            frames = 0;
+            std::fill(accum, &accum[_N], 0);
+        }
+
+        // Frames that went into the current estimate
+        int getFrameCount() {
+            return frames;
+        }
+
+        void process(std::complex<float> *in, int count) {
+            DSP_INSTRUMENT("fft::welchPowerSpectrum", count);
+            // Less than N samples are left over after every call, they're only moved to the front once at least as many have been consumed
+            if (pendingStart > 0 && pendingStart >= pending.size() - pendingStart) {
+                pending.erase(pending.begin(), pending.begin() + pendingStart);
+                pendingStart = 0;
+            }
+            pending.insert(pending.end(), in, &in[count]);
+
+            while (pendingStart + _N <= pending.size()) {
+                int available = ((pending.size() - pendingStart - _N) / hop) + 1;
+                int n = std::min(available, _batch);
+                for (int f = 0; f < n; f++) {
+                    volk_32fc_32f_multiply_32fc((lv_32fc_t *)&fftin[f * _N], (lv_32fc_t *)&pending[pendingStart], fft_window, _N);
+                    pendingStart += hop;
+                }
+                fftwf_execute_dft(plans[n - 1], fftin, fftout);
+                volk_32fc_magnitude_squared_32f(power, (lv_32fc_t *)fftout, _N * n);
+                for (int f = 0; f < n; f++) {
+                    accumulate(&power[f * _N]);
+                }
+            }
+        }
+
+        // Power normalized the same way as complexPowerSpectrum, optionally in dB
+        void getSpectrum(float *out, bool dB = true) {
+            float scale = 1.0f / ((float)_N * (float)_N);
+            if (_mode == linear && frames > 0) {
+                scale /= frames;
+            }
+            volk_32f_s32f_multiply_32f(out, accum, scale, _N);
+            if (dB) {
+                for (int i = 0; i < _N; i++) {
+                    out[i] = std::max(out[i], 1e-20f);
+                }
+                volk_32f_log2_32f(out, out, _N);
+                volk_32f_s32f_multiply_32f(out, out, 10.0f * log10f(2.0f), _N);
+            }
+        }
+
+    private:
+        void accumulate(float *frame) {
+            if (frames == 0) {
+                memcpy(accum, frame, sizeof(float) * _N);
+            } else if (_mode == linear) {
+                volk_32f_x2_add_32f(accum, accum, frame, _N);
+            } else if (_mode == exponential) {
+                for (int i = 0; i < _N; i++) {
+                    accum[i] += _alpha * (frame[i] - accum[i]);
+                }
+            } else {
+                volk_32f_x2_max_32f(accum, accum, frame, _N);
+            }
+            frames++;
+        }
+
+        fftwf_complex *fftin;
+        fftwf_complex *fftout;
+        std::vector<fftwf_plan> plans;
+        float *fft_window;
+        float *power;
+        float *accum;
+        std::vector<std::complex<float>> pending;
+        size_t pendingStart = 0;
+        int _N;
+        int hop;
+        averaging _mode;
+        int _batch;
+        float _alpha;
+        int frames = 0;
+    };
 }
@@ -1,41 +1,47 @@
 #pragma once
 
+#include "fftplan.h"
+#include "firfilters.h"
+#include "instrumentation.h"
 #include "window.h"
+#include <complex>
 #include <cstring>
 #include <fftw3.h>
+#include <type_traits>
 #include <volk/volk.h>
 
 namespace dsp {
     namespace filters {
         // https://github.com/AlexandreRouma/SDRPlusPlus/blob/master/core/src/dsp/noise_reduction.h
 
-        // This filter is very slow, replacement soon:tm:
+        // This filter is very slow, use hilbertFIR instead
         class fftbrickwallhilbert {
         public:
             fftbrickwallhilbert(int tapcount, int chunksize) {
                 _chunksize = chunksize;
                 _tapcount = tapcount;
 
-                delay = (std::complex<float> *)fftwf_malloc(sizeof(std::complex<float>) * _chunksize * 2);
+                delay = (float *)fftwf_malloc(sizeof(float) * _chunksize * 2);
                 delay_start = &delay[_tapcount];
-                memset(delay, 0, sizeof(std::complex<float>) * _chunksize * 2);
+                memset(delay, 0, sizeof(float) * _chunksize * 2);
 
                 fft_window = (float *)fftwf_malloc(sizeof(float) * _tapcount);
                 for (int i = 0; i < _tapcount; i++) {
                     fft_window[i] = windowfunctions::blackman(i, _tapcount - 1);
                 }
 
-                fft_in = (std::complex<float> *)fftwf_malloc(sizeof(std::complex<float>) * _tapcount);
-                fft_cout = (std::complex<float> *)fftwf_malloc(sizeof(std::complex<float>) * _tapcount);
+                // The input is real so the forward transform only needs half the spectrum
+                fft_in = (float *)fftwf_malloc(sizeof(float) * _tapcount);
+                fft_cout = (std::complex<float> *)fftwf_malloc(sizeof(std::complex<float>) * ((_tapcount / 2) + 1));
                 fft_cin = (std::complex<float> *)fftwf_malloc(sizeof(std::complex<float>) * _tapcount);
                 fft_fcout = (std::complex<float> *)fftwf_malloc(sizeof(std::complex<float>) * _tapcount);
-                memset(fft_in, 0, sizeof(std::complex<float>) * _tapcount);
-                memset(fft_cout, 0, sizeof(std::complex<float>) * _tapcount);
+                memset(fft_in, 0, sizeof(float) * _tapcount);
+                memset(fft_cout, 0, sizeof(std::complex<float>) * ((_tapcount / 2) + 1));
                 memset(fft_cin, 0, sizeof(std::complex<float>) * _tapcount);
                 memset(fft_fcout, 0, sizeof(std::complex<float>) * _tapcount);
 
-                forwardPlan = fftwf_plan_dft_1d(_tapcount, (fftwf_complex *)fft_in, (fftwf_complex *)fft_cout, FFTW_FORWARD, FFTW_ESTIMATE);
-                backwardPlan = fftwf_plan_dft_1d(_tapcount, (fftwf_complex *)fft_cin, (fftwf_complex *)fft_fcout, FFTW_BACKWARD, FFTW_ESTIMATE);
+                forwardPlan = fft::planCache::get().getPlan(fft::planCache::r2c, _tapcount);
+                backwardPlan = fft::planCache::get().getPlan(fft::planCache::c2c_backward, _tapcount);
             }
 
             ~fftbrickwallhilbert() {
@@ -46,20 +52,16 @@ namespace dsp {
                 fftwf_free(fft_cout);
                 fftwf_free(fft_cin);
                 fftwf_free(fft_fcout);
-
-                fftwf_destroy_plan(forwardPlan);
-                fftwf_destroy_plan(backwardPlan);
             }
 
             void processSamples(int count, float *inf, std::complex<float> *out) {
+                DSP_INSTRUMENT("filters::fftbrickwallhilbert", count);
+                memcpy(delay_start, inf, count * sizeof(float));
                 for (int i = 0; i < count; i++) {
-                    delay_start[i] = {inf[i], 0};
-                }
-                for (int i = 0; i < count; i++) {
-                    volk_32fc_32f_multiply_32fc((lv_32fc_t *)fft_in, (lv_32fc_t *)&delay[i], fft_window, _tapcount);
+                    volk_32f_x2_multiply_32f(fft_in, &delay[i], fft_window, _tapcount);
 
                     // Forward FFT
-                    fftwf_execute(forwardPlan);
+                    fftwf_execute_dft_r2c(forwardPlan, fft_in, (fftwf_complex *)fft_cout);
 
                     // Copy forward FFT out to Backward FFT input
                     // memcpy(fft_cin, fft_cout, sizeof(std::complex<float>) * _tapcount);
@@ -74,13 +76,13 @@ namespace dsp {
                     }
 
                     // Backward FFT and write middle element to output buffer
-                    fftwf_execute(backwardPlan);
+                    fftwf_execute_dft(backwardPlan, (fftwf_complex *)fft_cin, (fftwf_complex *)fft_fcout);
                     out[i] = fft_fcout[_tapcount / 2];
                 }
                 volk_32f_s32f_multiply_32f((float *)out, (float *)out, 1.0f / (float)_tapcount, count * 2);
 
                 // Copy last values to delay
-                memmove(delay, &delay[count], _tapcount * sizeof(std::complex<float>));
+                memmove(delay, &delay[count], _tapcount * sizeof(float));
             }
 
         private:
@@ -92,14 +94,168 @@ namespace dsp {
             fftwf_plan forwardPlan;
             fftwf_plan backwardPlan;
 
-            std::complex<float> *delay_start;
-            std::complex<float> *delay;
+            float *delay_start;
+            float *delay;
 
-            std::complex<float> *fft_in;
+            float *fft_in;
             std::complex<float> *fft_cout;
             std::complex<float> *fft_cin;
             std::complex<float> *fft_fcout;
         };
+
+        // Overlap-save fast convolution, gives the same output as FIRfilter but the cost per sample only grows with log(taps).
+        // Real signals use r2c/c2r transforms and only keep half the spectrum
+        template <class T>
+        class fftFIRfilter {
+        public:
+            fftFIRfilter(std::vector<float> taps, int chunkSize) {
+                _ntaps = taps.size();
+                fftSize = calcFFTSize(_ntaps, chunkSize);
+                blockSize = fftSize - (_ntaps - 1);
+                bins = isReal ? (fftSize / 2) + 1 : fftSize;
+
+                fft_in = (T *)fftwf_malloc(sizeof(T) * fftSize);
+                fft_out = (std::complex<float> *)fftwf_malloc(sizeof(std::complex<float>) * bins);
+                fft_res = (T *)fftwf_malloc(sizeof(T) * fftSize);
+                tapsFreq = (std::complex<float> *)fftwf_malloc(sizeof(std::complex<float>) * bins);
+
+                if constexpr (isReal) {
+                    forwardPlan = fft::planCache::get().getPlan(fft::planCache::r2c, fftSize);
+                    backwardPlan = fft::planCache::get().getPlan(fft::planCache::c2r, fftSize);
+                } else {
+                    forwardPlan = fft::planCache::get().getPlan(fft::planCache::c2c_forward, fftSize);
+                    backwardPlan = fft::planCache::get().getPlan(fft::planCache::c2c_backward, fftSize);
+                }
+
+                // FIRfilter correlates with the taps, so the taps are reversed here to get the exact same output. The 1/N of the inverse FFT is folded in as well
+                std::fill(fft_in, &fft_in[fftSize], 0);
+                for (int i = 0; i < _ntaps; i++) {
+                    fft_in[i] = taps[(_ntaps - 1) - i] / (float)fftSize;
+                }
+                forward();
+                memcpy(tapsFreq, fft_out, sizeof(std::complex<float>) * bins);
+
+                // fft_in holds the last _ntaps - 1 input samples in front of the new block
+                std::fill(fft_in, &fft_in[fftSize], 0);
+            }
+
+            ~fftFIRfilter() {
+                fftwf_free(fft_in);
+                fftwf_free(fft_out);
+                fftwf_free(fft_res);
+                fftwf_free(tapsFreq);
+            }
+
+            void run(T *in, T *out, size_t count) {
+                DSP_INSTRUMENT("filters::fftFIRfilter", count);
+                for (size_t done = 0; done < count;) {
+                    int n = std::min((size_t)blockSize, count - done);
+                    memcpy(&fft_in[_ntaps - 1], &in[done], n * sizeof(T));
+                    std::fill(&fft_in[(_ntaps - 1) + n], &fft_in[fftSize], 0);
+
+                    forward();
+                    volk_32fc_x2_multiply_32fc((lv_32fc_t *)fft_out, (lv_32fc_t *)fft_out, (lv_32fc_t *)tapsFreq, bins);
+                    backward();
+
+                    // Only the last n outputs are free of circular wraparound
+                    memcpy(&out[done], &fft_res[_ntaps - 1], n * sizeof(T));
+
+                    memmove(fft_in, &fft_in[n], (_ntaps - 1) * sizeof(T));
+                    done += n;
+                }
+            }
+
+            // Power of two, big enough for a whole chunk but not much bigger than a few times the taps
+            static int calcFFTSize(int ntaps, int chunkSize) {
+                int want = (ntaps - 1) + std::min(chunkSize, ntaps * 4);
+                int size = 1;
+                while (size < want) {
+                    size <<= 1;
+                }
+                return size;
+            }
+
+            // Rough flop estimate of both forms for the given tap count and chunk size
+            static bool fftIsFaster(int ntaps, int chunkSize) {
+                int size = calcFFTSize(ntaps, chunkSize);
+                int block = std::min(size - (ntaps - 1), chunkSize);
+                double directCost = 2.0 * ntaps;
+                double fftCost = ((2.0 * 5.0 * size * log2(size)) + (6.0 * size)) / block;
+                if constexpr (isReal) {
+                    fftCost /= 2.0;
+                } else {
+                    directCost *= 2.0;
+                }
+                return fftCost < directCost;
+            }
+
+        private:
+            static constexpr bool isReal = std::is_same_v<T, float>;
+
+            void forward() {
+                if constexpr (isReal) {
+                    fftwf_execute_dft_r2c(forwardPlan, fft_in, (fftwf_complex *)fft_out);
+                } else {
+                    fftwf_execute_dft(forwardPlan, (fftwf_complex *)fft_in, (fftwf_complex *)fft_out);
+                }
+            }
+
+            // c2r overwrites fft_out, that's fine since it's refilled every block
+            void backward() {
+                if constexpr (isReal) {
+                    fftwf_execute_dft_c2r(backwardPlan, (fftwf_complex *)fft_out, fft_res);
+                } else {
+                    fftwf_execute_dft(backwardPlan, (fftwf_complex *)fft_out, (fftwf_complex *)fft_res);
+                }
+            }
+
+            int _ntaps;
+            int fftSize;
+            int blockSize;
+            int bins;
+
+            fftwf_plan forwardPlan;
+            fftwf_plan backwardPlan;
+
+            T *fft_in;
+            std::complex<float> *fft_out;
+            T *fft_res;
+            std::complex<float> *tapsFreq;
+        };
+
+        // Picks the direct form or the FFT form depending on which one is cheaper for the tap count and chunk size
+        template <class T>
+        class autoFIRfilter {
+        public:
+            autoFIRfilter(std::vector<float> taps, int chunkSize) {
+                if (fftFIRfilter<T>::fftIsFaster(taps.size(), chunkSize)) {
+                    fftfir = new fftFIRfilter<T>(taps, chunkSize);
+                } else {
+                    fir = new FIR<T>(taps, chunkSize);
+                }
+            }
+
+            ~autoFIRfilter() {
+                delete fir;
+                delete fftfir;
+            }
+
+            bool usesFFT() {
+                return fftfir != nullptr;
+            }
+
+            void run(T *in, T *out, size_t count) {
+                if (fftfir != nullptr) {
+                    fftfir->run(in, out, count);
+                } else {
+                    fir->run(in, out, count);
+                }
+            }
+
+        private:
+            FIR<T> *fir = nullptr;
+            fftFIRfilter<T> *fftfir = nullptr;
+        };
     }
 
 }
@@ -0,0 +1,89 @@
+#pragma once
+#include <fftw3.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+
+namespace dsp::fft {
+    // Process wide FFTW plan registry. FFTW planning isn't thread safe, so every plan is made here under one lock and shared
+    // between all blocks that need the same transform. Execute the plans with the new-array functions (fftwf_execute_dft), that part is thread safe.
+    // Plans are made on fftwf_malloc'd scratch arrays so they work with any array that came from fftwf_malloc
+    class planCache {
+    public:
+        // r2c is always forward and c2r always backward, with n / 2 + 1 complex bins. c2r plans destroy their input
+        enum type { c2c_forward, c2c_backward, r2c, c2r };
+
+        static planCache &get() {
+            static planCache cache;
+            return cache;
+        }
+
+        planCache(const planCache &) = delete;
+        planCache &operator=(const planCache &) = delete;
+
+        // howmany > 1 gives a batched plan over howmany contiguous transforms of size n
+        fftwf_plan getPlan(type t, int n, int howmany = 1, bool inplace = false) {
+            std::lock_guard<std::mutex> lck(mtx);
+            key k = {t, n, howmany, inplace, flags};
+            auto it = plans.find(k);
+            if (it != plans.end()) {
+                return it->second;
+            }
+
+            // Big enough for either side of any of the transform types, in place real transforms use the padded layout
+            int bins = (n / 2) + 1;
+            int realDist = inplace ? bins * 2 : n;
+            fftwf_complex *in = (fftwf_complex *)fftwf_malloc(sizeof(fftwf_complex) * n * howmany);
+            fftwf_complex *out = inplace ? in : (fftwf_complex *)fftwf_malloc(sizeof(fftwf_complex) * n * howmany);
+            fftwf_plan plan;
+            if (t == r2c) {
+                plan = fftwf_plan_many_dft_r2c(1, &n, howmany, (float *)in, nullptr, 1, realDist, out, nullptr, 1, bins, flags);
+            } else if (t == c2r) {
+                plan = fftwf_plan_many_dft_c2r(1, &n, howmany, in, nullptr, 1, bins, (float *)out, nullptr, 1, realDist, flags);
+            } else {
+                int sign = t == c2c_forward ? FFTW_FORWARD : FFTW_BACKWARD;
+                plan = fftwf_plan_many_dft(1, &n, howmany, in, nullptr, 1, n, out, nullptr, 1, n, sign, flags);
+            }
+            if (!inplace) {
+                fftwf_free(out);
+            }
+            fftwf_free(in);
+
+            plans[k] = plan;
+            return plan;
+        }
+
+        // FFTW_ESTIMATE by default. Slower planning flags (FFTW_MEASURE, FFTW_PATIENT) pay off together with saved wisdom
+        void setPlanningFlags(unsigned int planningFlags) {
+            std::lock_guard<std::mutex> lck(mtx);
+            flags = planningFlags;
+        }
+
+        bool loadWisdom(std::string path) {
+            std::lock_guard<std::mutex> lck(mtx);
+            return fftwf_import_wisdom_from_filename(path.c_str()) != 0;
+        }
+
+        bool saveWisdom(std::string path) {
+            std::lock_guard<std::mutex> lck(mtx);
+            return fftwf_export_wisdom_to_filename(path.c_str()) != 0;
+        }
+
+    private:
+        planCache() {}
+
+        ~planCache() {
+            for (auto &p : plans) {
+                fftwf_destroy_plan(p.second);
+            }
+        }
+
+        // type, size, howmany, inplace, flags
+        using key = std::tuple<int, int, int, bool, unsigned int>;
+
+        std::mutex mtx;
+        std::map<key, fftwf_plan> plans;
+        unsigned int flags = FFTW_ESTIMATE;
+    };
+}
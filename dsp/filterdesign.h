@@ -0,0 +1,446 @@
+#pragma once
+#include "firfilters.h"
+#include "math.h"
+#include "window.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+// Minimum length FIR design from a spec, either with a kaiser window or equiripple (Parks-McClellan). Every design is linear phase with
+// an odd tap count (type I), which works for all four filter types. All taps have unity passband gain
+namespace dsp::filters::design {
+    // Band edges in Hz, ascending:
+    // lowpass  {pass, stop}
+    // highpass {stop, pass}
+    // bandpass {stop1, pass1, pass2, stop2}
+    // bandstop {pass1, stop1, stop2, pass2}
+    struct spec {
+        FIRcoeffcalc::filter_type type;
+        double samplerate;
+        double edges[4];
+        double passbandRipple;      // peak to peak, dB
+        double stopbandAttenuation; // dB
+    };
+
+    enum method { kaiser, equiripple };
+
+    constexpr int maxTaps = 4095;
+
+    inline double passbandDeviation(const spec &s) {
+        double r = pow(10, s.passbandRipple / 20);
+        return (r - 1) / (r + 1);
+    }
+
+    inline double stopbandDeviation(const spec &s) {
+        return pow(10, -s.stopbandAttenuation / 20);
+    }
+
+    inline int edgeCount(const spec &s) {
+        return (s.type == FIRcoeffcalc::lowpass || s.type == FIRcoeffcalc::highpass) ? 2 : 4;
+    }
+
+    // Narrowest transition band, normalized to the samplerate
+    inline double transitionWidth(const spec &s) {
+        double width = (s.edges[1] - s.edges[0]) / s.samplerate;
+        if (edgeCount(s) == 4) {
+            width = std::min(width, (s.edges[3] - s.edges[2]) / s.samplerate);
+        }
+        return width;
+    }
+
+    // Edges ascending and inside (0, samplerate / 2), ripple and attenuation positive. Written so NaNs fail too
+    inline bool validSpec(const spec &s) {
+        if (!(s.samplerate > 0) || !(s.passbandRipple > 0) || !(s.stopbandAttenuation > 0)) {
+            return false;
+        }
+        int n = edgeCount(s);
+        if (!(s.edges[0] > 0) || !(s.edges[n - 1] < s.samplerate / 2)) {
+            return false;
+        }
+        for (int i = 1; i < n; i++) {
+            if (!(s.edges[i] > s.edges[i - 1])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Edges in cycles per sample, lowpass and highpass only set the first two so the rest are zeroed instead of read
+    inline void normalizedEdges(const spec &s, double e[4]) {
+        int n = edgeCount(s);
+        for (int i = 0; i < 4; i++) {
+            e[i] = i < n ? s.edges[i] / s.samplerate : 0;
+        }
+    }
+
+    inline int makeOdd(int taps) {
+        return std::max(taps, 3) | 1;
+    }
+
+    inline double kaiserBeta(double attenuation) {
+        if (attenuation > 50) {
+            return 0.1102 * (attenuation - 8.7);
+        } else if (attenuation >= 21) {
+            return (0.5842 * pow(attenuation - 21, 0.4)) + (0.07886 * (attenuation - 21));
+        }
+        return 0;
+    }
+
+    // Kaiser's estimate, the window has the same deviation in pass and stopband so the smaller one decides
+    inline int kaiserOrder(const spec &s) {
+        double attenuation = -20 * log10(std::min(passbandDeviation(s), stopbandDeviation(s)));
+        return makeOdd((int)ceil((attenuation - 7.95) / (14.36 * transitionWidth(s))) + 1);
+    }
+
+    // Estimate for equiripple filters (Kaiser/Herrmann), usually a bit below what is really needed
+    inline int equirippleOrder(const spec &s) {
+        double d = -20 * log10(sqrt(passbandDeviation(s) * stopbandDeviation(s)));
+        return makeOdd((int)ceil((d - 13) / (14.6 * transitionWidth(s))) + 1);
+    }
+
+    // Bands in cycles per sample for the remez designer
+    struct band {
+        double start;
+        double end;
+        double desired;
+        double weight;
+    };
+
+    inline std::vector<band> specBands(const spec &s) {
+        double p = 1 / passbandDeviation(s);
+        double st = 1 / stopbandDeviation(s);
+        double e[4];
+        normalizedEdges(s, e);
+        switch (s.type) {
+        case FIRcoeffcalc::lowpass:
+            return {{0, e[0], 1, p}, {e[1], 0.5, 0, st}};
+        case FIRcoeffcalc::highpass:
+            return {{0, e[0], 0, st}, {e[1], 0.5, 1, p}};
+        case FIRcoeffcalc::bandpass:
+            return {{0, e[0], 0, st}, {e[1], e[2], 1, p}, {e[3], 0.5, 0, st}};
+        case FIRcoeffcalc::bandstop:
+            return {{0, e[0], 1, p}, {e[1], e[2], 0, st}, {e[3], 0.5, 1, p}};
+        }
+        return {};
+    }
+
+    // Zero phase amplitude response of an odd length symmetric filter at f cycles per sample. The response is a Chebyshev series in cos(2 pi f),
+    // the Clenshaw recurrence sums it without a cos per tap
+    inline double amplitude(const std::vector<float> &taps, double f) {
+        int M = taps.size() / 2;
+        double x = cos(2 * M_PI * f);
+        double b1 = 0;
+        double b2 = 0;
+        for (int k = M; k >= 1; k--) {
+            double b0 = (2 * taps[M - k]) + (2 * x * b1) - b2;
+            b2 = b1;
+            b1 = b0;
+        }
+        return taps[M] + (x * b1) - b2;
+    }
+
+    // Checks the response on a dense grid, with a little slack for float taps
+    inline bool meetsSpec(const std::vector<float> &taps, const spec &s) {
+        double dp = passbandDeviation(s) * 1.001;
+        double ds = stopbandDeviation(s) * 1.001;
+        int points = std::max(1024, (int)taps.size() * 16);
+        for (band b : specBands(s)) {
+            for (int i = 0; i <= points; i++) {
+                double f = b.start + (((b.end - b.start) * i) / points);
+                if (fabs(amplitude(taps, f) - b.desired) > (b.desired != 0 ? dp : ds)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    inline std::vector<float> kaiserTaps(const spec &s, int taps) {
+        double beta = kaiserBeta(-20 * log10(std::min(passbandDeviation(s), stopbandDeviation(s))));
+        double e[4];
+        normalizedEdges(s, e);
+
+        // Ideal filter with the cutoffs in the middle of the transition bands
+        double c1 = (e[0] + e[1]) / 2;
+        double c2 = (e[2] + e[3]) / 2;
+        std::vector<float> out(taps);
+        for (int i = 0; i < taps; i++) {
+            int x = i - (taps / 2);
+            auto lp = [x](double fc) { return x == 0 ? 2 * fc : sin(2 * M_PI * fc * x) / (M_PI * x); };
+            double h = 0;
+            switch (s.type) {
+            case FIRcoeffcalc::lowpass:
+                h = lp(c1);
+                break;
+            case FIRcoeffcalc::highpass:
+                h = (x == 0 ? 1 : 0) - lp(c1);
+                break;
+            case FIRcoeffcalc::bandpass:
+                h = lp(c2) - lp(c1);
+                break;
+            case FIRcoeffcalc::bandstop:
+                h = (x == 0 ? 1 : 0) - (lp(c2) - lp(c1));
+                break;
+            }
+            out[i] = h * windowfunctions::kaiser(i, taps - 1, beta);
+        }
+        return out;
+    }
+
+    // Parks-McClellan for odd length symmetric filters, bands in cycles per sample. Returns an empty vector if the exchange doesn't converge
+    // within 100 iterations
+    inline std::vector<float> remez(int taps, const std::vector<band> &bands, int gridDensity = 16) {
+        taps = makeOdd(taps);
+        int M = (taps - 1) / 2;
+        int r = M + 2; // extremal frequencies
+
+        // Dense grid over all bands, the grid includes every band edge
+        std::vector<double> grid, desired, weight;
+        double total = 0;
+        for (const band &b : bands) {
+            total += b.end - b.start;
+        }
+        double step = total / (gridDensity * r);
+        for (const band &b : bands) {
+            int n = std::max(2, (int)ceil((b.end - b.start) / step) + 1);
+            for (int i = 0; i < n; i++) {
+                grid.push_back(cos(2 * M_PI * (b.start + (((b.end - b.start) * i) / (n - 1)))));
+                desired.push_back(b.desired);
+                weight.push_back(b.weight);
+            }
+        }
+        int gridSize = grid.size();
+        if (gridSize < r) {
+            return {};
+        }
+
+        std::vector<int> ext(r);
+        for (int i = 0; i < r; i++) {
+            ext[i] = (int)(((double)i * (gridSize - 1)) / (r - 1));
+        }
+
+        // Barycentric weights, the factor 2 and interleaved order keep the products from over- or underflowing
+        auto baryWeights = [](const std::vector<double> &x, int n) {
+            std::vector<double> w(n);
+            int interleave = ((n - 1) / 15) + 1;
+            for (int i = 0; i < n; i++) {
+                double d = 1;
+                for (int k = 0; k < interleave; k++) {
+                    for (int j = k; j < n; j += interleave) {
+                        if (j != i) {
+                            d *= 2 * (x[i] - x[j]);
+                        }
+                    }
+                }
+                w[i] = 1 / d;
+            }
+            return w;
+        };
+
+        std::vector<double> x(r), c(M + 1), error(gridSize);
+        std::vector<double> bw;
+        double delta = 0;
+        auto evaluate = [&](double xv) {
+            double num = 0;
+            double den = 0;
+            for (int i = 0; i <= M; i++) {
+                double d = xv - x[i];
+                if (fabs(d) < 1e-15) {
+                    return c[i];
+                }
+                num += (bw[i] / d) * c[i];
+                den += bw[i] / d;
+            }
+            return num / den;
+        };
+
+        bool converged = false;
+        for (int iteration = 0; iteration < 100 && !converged; iteration++) {
+            for (int i = 0; i < r; i++) {
+                x[i] = grid[ext[i]];
+            }
+
+            std::vector<double> w = baryWeights(x, r);
+            double num = 0;
+            double den = 0;
+            for (int i = 0; i < r; i++) {
+                double sign = (i % 2) ? -1 : 1;
+                num += w[i] * desired[ext[i]];
+                den += (sign * w[i]) / weight[ext[i]];
+            }
+            delta = num / den;
+
+            for (int i = 0; i <= M; i++) {
+                double sign = (i % 2) ? -1 : 1;
+                c[i] = desired[ext[i]] - ((sign * delta) / weight[ext[i]]);
+            }
+            bw = baryWeights(x, M + 1);
+
+            for (int i = 0; i < gridSize; i++) {
+                error[i] = weight[i] * (desired[i] - evaluate(grid[i]));
+            }
+
+            // Local extrema of the error (grid ends count), then keep alternating signs only
+            std::vector<int> candidates;
+            for (int i = 0; i < gridSize; i++) {
+                double e = error[i];
+                bool left = i == 0 || fabs(e) >= fabs(error[i - 1]) || (e * error[i - 1]) <= 0;
+                bool right = i == gridSize - 1 || fabs(e) >= fabs(error[i + 1]) || (e * error[i + 1]) <= 0;
+                if (left && right && fabs(e) >= fabs(delta) * 0.999) {
+                    candidates.push_back(i);
+                }
+            }
+            std::vector<int> alternating;
+            for (int i : candidates) {
+                if (!alternating.empty() && (error[i] > 0) == (error[alternating.back()] > 0)) {
+                    if (fabs(error[i]) > fabs(error[alternating.back()])) {
+                        alternating.back() = i;
+                    }
+                } else {
+                    alternating.push_back(i);
+                }
+            }
+            while ((int)alternating.size() > r) {
+                if (fabs(error[alternating.front()]) < fabs(error[alternating.back()])) {
+                    alternating.erase(alternating.begin());
+                } else {
+                    alternating.pop_back();
+                }
+            }
+            if ((int)alternating.size() < r) {
+                return {};
+            }
+
+            double maxError = 0;
+            for (int i : alternating) {
+                maxError = std::max(maxError, fabs(error[i]));
+            }
+            converged = ((maxError - fabs(delta)) / maxError) < 1e-6;
+            ext = alternating;
+        }
+        if (!converged) {
+            return {};
+        }
+
+        // Taps from the amplitude response sampled at taps equally spaced frequencies
+        std::vector<double> A(M + 1);
+        for (int k = 0; k <= M; k++) {
+            A[k] = evaluate(cos((2 * M_PI * k) / taps));
+        }
+        std::vector<float> out(taps);
+        for (int n = 0; n <= M; n++) {
+            double h = A[0];
+            for (int k = 1; k <= M; k++) {
+                h += 2 * A[k] * cos((2 * M_PI * k * (n - M)) / taps);
+            }
+            out[n] = h / taps;
+            out[(taps - 1) - n] = out[n];
+        }
+        return out;
+    }
+
+    // Shortest filter that meets the spec. From the order estimate the step grows exponentially until the result flips between passing and
+    // failing, then the last step is bisected, so a bad estimate costs a few designs instead of one per tap pair.
+    // Returns an empty vector for invalid specs or if nothing up to maxTaps meets the spec
+    inline std::vector<float> designUncached(const spec &s, method m) {
+        if (!validSpec(s)) {
+            return {};
+        }
+
+        // Searching over k with taps = 2k + 1, k = 0 (a single tap) never passes
+        std::vector<float> best;
+        auto ok = [&](int k) {
+            std::vector<float> t = m == kaiser ? kaiserTaps(s, (2 * k) + 1) : remez((2 * k) + 1, specBands(s));
+            if (t.empty() || !meetsSpec(t, s)) {
+                return false;
+            }
+            best = t;
+            return true;
+        };
+
+        int maxK = (maxTaps - 1) / 2;
+        int estimate = std::min((m == kaiser ? kaiserOrder(s) : equirippleOrder(s)) / 2, maxK);
+        int good;
+        int bad;
+        if (ok(estimate)) {
+            good = estimate;
+            bad = 0;
+            for (int step = 1; good - step > 0; step *= 2) {
+                if (!ok(good - step)) {
+                    bad = good - step;
+                    break;
+                }
+                good -= step;
+            }
+        } else {
+            bad = estimate;
+            for (int step = 1;; step *= 2) {
+                if (bad == maxK) {
+                    return {};
+                }
+                int k = std::min(bad + step, maxK);
+                if (ok(k)) {
+                    good = k;
+                    break;
+                }
+                bad = k;
+            }
+        }
+
+        // Every pass lowers good, so best always holds the taps for good
+        while (good - bad > 1) {
+            int mid = (good + bad) / 2;
+            if (ok(mid)) {
+                good = mid;
+            } else {
+                bad = mid;
+            }
+        }
+        return best;
+    }
+
+    // Designs are deterministic, so repeated specs are only designed once per process
+    class designCache {
+    public:
+        static designCache &get() {
+            static designCache cache;
+            return cache;
+        }
+
+        designCache(const designCache &) = delete;
+        designCache &operator=(const designCache &) = delete;
+
+        std::vector<float> design(const spec &s, method m) {
+            // Unused edges are left out, they may never have been set
+            int n = edgeCount(s);
+            key k = {m, s.type, s.samplerate, s.edges[0], s.edges[1], n == 4 ? s.edges[2] : 0, n == 4 ? s.edges[3] : 0, s.passbandRipple, s.stopbandAttenuation};
+            {
+                std::lock_guard<std::mutex> lck(mtx);
+                auto it = designs.find(k);
+                if (it != designs.end()) {
+                    return it->second;
+                }
+            }
+
+            // Designing can take a while, so it's done without holding the lock
+            std::vector<float> taps = designUncached(s, m);
+            std::lock_guard<std::mutex> lck(mtx);
+            designs[k] = taps;
+            return taps;
+        }
+
+    private:
+        designCache() {}
+
+        typedef std::tuple<int, int, double, double, double, double, double, double, double> key;
+        std::mutex mtx;
+        std::map<key, std::vector<float>> designs;
+    };
+
+    inline std::vector<float> design(const spec &s, method m = equiripple) {
+        return designCache::get().design(s, m);
+    }
+}
@@ -1,17 +1,113 @@
 #pragma once
+#include "instrumentation.h"
 #include "math.h"
 #include "window.h"
+#include <algorithm>
+#include <cassert>
+#include <complex>
 #include <string.h>
 #include <vector>
 #include <volk/volk.h>
 
 namespace dsp {
     namespace filters {
+        inline void dotProduct(float *out, const float *in, const float *taps, unsigned int count) {
+            volk_32f_x2_dot_prod_32f(out, in, taps, count);
+        }
+
+        inline void dotProduct(std::complex<float> *out, const std::complex<float> *in, const float *taps, unsigned int count) {
+            volk_32fc_32f_dot_prod_32fc((lv_32fc_t *)out, (const lv_32fc_t *)in, taps, count);
+        }
+
+        inline void dotProduct(std::complex<float> *out, const std::complex<float> *in, const std::complex<float> *taps, unsigned int count) {
+            volk_32fc_x2_dot_prod_32fc((lv_32fc_t *)out, (const lv_32fc_t *)in, (const lv_32fc_t *)taps, count);
+        }
+
+        inline void dotProduct(std::complex<float> *out, const float *in, const std::complex<float> *taps, unsigned int count) {
+            volk_32fc_32f_dot_prod_32fc((lv_32fc_t *)out, (const lv_32fc_t *)taps, in, count);
+        }
+
+        // Fixed length dot products, the sums are split over independent lanes so the compiler can fully unroll and vectorize them without reordering float additions
+        namespace kernels {
+            constexpr int lanes = 8;
+
+            template <int N>
+            inline void dotProduct(float *out, const float *in, const float *taps) {
+                float acc[lanes] = {};
+                for (int i = 0; i < N; i++) {
+                    acc[i % lanes] += in[i] * taps[i];
+                }
+                float sum = 0;
+                for (int i = 0; i < lanes; i++) {
+                    sum += acc[i];
+                }
+                *out = sum;
+            }
+
+            template <int N>
+            inline void dotProduct(std::complex<float> *out, const std::complex<float> *in, const float *taps) {
+                const float *inf = (const float *)in;
+                float re[lanes] = {};
+                float im[lanes] = {};
+                for (int i = 0; i < N; i++) {
+                    re[i % lanes] += inf[i * 2] * taps[i];
+                    im[i % lanes] += inf[(i * 2) + 1] * taps[i];
+                }
+                float sumRe = 0;
+                float sumIm = 0;
+                for (int i = 0; i < lanes; i++) {
+                    sumRe += re[i];
+                    sumIm += im[i];
+                }
+                *out = {sumRe, sumIm};
+            }
+
+            template <int N>
+            inline void dotProduct(std::complex<float> *out, const std::complex<float> *in, const std::complex<float> *taps) {
+                const float *inf = (const float *)in;
+                const float *tapsf = (const float *)taps;
+                float re[lanes] = {};
+                float im[lanes] = {};
+                for (int i = 0; i < N; i++) {
+                    re[i % lanes] += (inf[i * 2] * tapsf[i * 2]) - (inf[(i * 2) + 1] * tapsf[(i * 2) + 1]);
+                    im[i % lanes] += (inf[i * 2] * tapsf[(i * 2) + 1]) + (inf[(i * 2) + 1] * tapsf[i * 2]);
+                }
+                float sumRe = 0;
+                float sumIm = 0;
+                for (int i = 0; i < lanes; i++) {
+                    sumRe += re[i];
+                    sumIm += im[i];
+                }
+                *out = {sumRe, sumIm};
+            }
+
+            template <int N>
+            inline void dotProduct(std::complex<float> *out, const float *in, const std::complex<float> *taps) {
+                const float *tapsf = (const float *)taps;
+                float re[lanes] = {};
+                float im[lanes] = {};
+                for (int i = 0; i < N; i++) {
+                    re[i % lanes] += in[i] * tapsf[i * 2];
+                    im[i % lanes] += in[i] * tapsf[(i * 2) + 1];
+                }
+                float sumRe = 0;
+                float sumIm = 0;
+                for (int i = 0; i < lanes; i++) {
+                    sumRe += re[i];
+                    sumIm += im[i];
+                }
+                *out = {sumRe, sumIm};
+            }
+        }
+
         class FIRcoeffcalc {
         public:
             enum filter_type { lowpass, highpass, bandpass, bandstop };
 
             static std::vector<float> calcCoeffs(filter_type type, int taps, int samplerate, float frequency) {
+                if (type == highpass) {
+                    taps |= 1; // spectral inversion of the lowpass, only works with a center tap
+                }
                 std::vector<float> impulseresponse;
                 impulseresponse.resize(taps);
                 float sampletime = 1 / (float)samplerate;
@@ -23,6 +119,7 @@ namespace dsp {
                             impulseresponse[i] = 2 * frequency;
                             break;
                         case highpass:
+                            impulseresponse[i] = samplerate - (2 * frequency);
                             break;
                         }
                         continue;
@@ -32,12 +129,17 @@ namespace dsp {
                         impulseresponse[i] = sin(2 * FL_M_PI * frequency * sampletime * x) / (FL_M_PI * sampletime * x);
                         break;
                     case highpass:
+                        impulseresponse[i] = -sin(2 * FL_M_PI * frequency * sampletime * x) / (FL_M_PI * sampletime * x);
                         break;
                     }
                 }
 
                 for (int i = 0; i < taps; i++) {
-                    impulseresponse[i] /= frequency * 2;
+                    if (type == highpass) {
+                        impulseresponse[i] *= sampletime;
+                    } else {
+                        impulseresponse[i] /= frequency * 2;
+                    }
                     impulseresponse[i] *= windowfunctions::blackman(i, taps - 1);
                 }
 
@@ -45,6 +147,9 @@ namespace dsp {
             }
 
             static std::vector<float> calcCoeffs_band(filter_type type, int taps, int samplerate, float freq1, float freq2) {
+                if (type == bandstop) {
+                    taps |= 1; // spectral inversion of the bandpass, only works with a center tap
+                }
                 std::vector<float> impulseresponse;
                 impulseresponse.resize(taps);
                 float sampletime = 1 / (float)samplerate;
@@ -56,6 +161,7 @@ namespace dsp {
                             impulseresponse[i] = 2 * freq2 - 2 * freq1;
                             break;
                         case bandstop:
+                            impulseresponse[i] = samplerate - (2 * freq2 - 2 * freq1);
                             break;
                         }
                         continue;
@@ -65,6 +171,7 @@ namespace dsp {
                         impulseresponse[i] = (sin(2 * FL_M_PI * freq2 * sampletime * x) - sin(2 * FL_M_PI * freq1 * sampletime * x)) / (FL_M_PI * sampletime * x);
                         break;
                     case bandstop:
+                        impulseresponse[i] = -(sin(2 * FL_M_PI * freq2 * sampletime * x) - sin(2 * FL_M_PI * freq1 * sampletime * x)) / (FL_M_PI * sampletime * x);
                         break;
                     }
                 }
@@ -115,34 +222,163 @@ namespace dsp {
                     taps[i] = taps[i] * gain / scale;
             }
 
+            // Runs after a CIC decimator (or before a CIC interpolator) at the low rate and flattens the CIC droop below cutoff (cycles per sample
+            // at the low rate, below 0.5 and below the first CIC null at 1 / differentialDelay), above that it is a lowpass. The window centers
+            // the transition band on cutoff, so leave some room between the band of interest and cutoff. Frequency sampling of the inverse CIC
+            // response, blackman windowed, unity DC gain
+            static std::vector<float> cicCompensation(int taps, int order, int differentialDelay, int rate, float cutoff) {
+                assert(cutoff > 0 && cutoff < std::min(0.5, 1.0 / differentialDelay));
+                int points = std::max(4096, taps * 16);
+                std::vector<double> response(points);
+                for (int k = 0; k < points; k++) {
+                    double f = (0.5 * k) / (points - 1);
+                    if (f > cutoff) {
+                        response[k] = 0;
+                    } else if (k == 0) {
+                        response[k] = 1;
+                    } else {
+                        // CIC response at f cycles per low rate sample: sin(pi M f) / (R M sin(pi f / R))
+                        double cic = sin(M_PI * differentialDelay * f) / (rate * differentialDelay * sin((M_PI * f) / rate));
+                        response[k] = 1 / pow(fabs(cic), order);
+                    }
+                }
+
+                std::vector<float> impulseresponse(taps);
+                double sum = 0;
+                for (int i = 0; i < taps; i++) {
+                    double x = i - ((taps - 1) / 2.0);
+                    double h = 0;
+                    for (int k = 0; k < points; k++) {
+                        double w = (k == 0 || k == points - 1) ? 0.5 : 1;
+                        h += w * response[k] * cos((2 * M_PI * 0.5 * k * x) / (points - 1));
+                    }
+                    impulseresponse[i] = h * windowfunctions::blackman(i, taps - 1);
+                    sum += impulseresponse[i];
+                }
+                for (int i = 0; i < taps; i++) {
+                    impulseresponse[i] /= sum;
+                }
+                return impulseresponse;
+            }
+
         private:
         };
 
-        class FIRfilter {
+        // T is the sample type, TAP_T the tap type (float or std::complex<float> each). With NTAPS != 0 the tap count is fixed at compile time and unrolled kernels are used
+        template <class T, class TAP_T = float, int NTAPS = 0>
+        class FIR {
         public:
-            FIRfilter(std::vector<float> taps, int chunkSize) {
-                _taps = taps;
-                buffer = (float *)malloc(((chunkSize * 2) + _taps.size()) * sizeof(float));
-                bufferStart = &buffer[_taps.size() - 1];
-                memset(buffer, 0, ((chunkSize * 2) + _taps.size()) * sizeof(float));
+            using out_t = decltype(T() * TAP_T());
+
+            FIR(std::vector<TAP_T> taps, int chunkSize) {
+                static_assert(NTAPS >= 0);
+                assert(NTAPS == 0 || taps.size() == NTAPS);
+                _ntaps = taps.size();
+                _taps = (TAP_T *)volk_malloc(_ntaps * sizeof(TAP_T), volk_get_alignment());
+                std::copy(taps.begin(), taps.end(), _taps);
+                buffer = (T *)malloc(((chunkSize * 2) + _ntaps) * sizeof(T));
+                bufferStart = &buffer[_ntaps - 1];
+                std::fill(buffer, &buffer[(chunkSize * 2) + _ntaps], T(0));
             }
 
-            ~FIRfilter() {
+            ~FIR() {
+                volk_free(_taps);
                 free(buffer);
             }
 
-            void run(float *in, float *out, size_t count) {
-                memcpy(bufferStart, in, count * sizeof(float));
+            void run(T *in, out_t *out, size_t count) {
+                DSP_INSTRUMENT("filters::FIR", count);
+                memcpy(bufferStart, in, count * sizeof(T));
                 for (size_t i = 0; i < count; i++) {
-                    volk_32f_x2_dot_prod_32f(&out[i], &buffer[i], _taps.data(), _taps.size());
+                    if constexpr (NTAPS != 0) {
+                        kernels::dotProduct<NTAPS>(&out[i], &buffer[i], _taps);
+                    } else {
+                        dotProduct(&out[i], &buffer[i], _taps, _ntaps);
+                    }
+                }
+                memmove(buffer, &buffer[count], (_ntaps - 1) * sizeof(T));
+            }
+
+        private:
+            TAP_T *_taps;
+            size_t _ntaps;
+            T *buffer;
+            T *bufferStart;
+        };
+
+        using FIRfilter = FIR<float>;
+
+        // Real to analytic signal converter, windowed Hilbert FIR. Every other Hilbert tap is zero, so the input is split into even and odd samples and only the nonzero taps are used
+        class hilbertFIR {
+        public:
+            hilbertFIR(int tapcount, int chunksize) {
+                // tapcount = 4k + 3 so the outermost taps are at odd offsets, where the Hilbert response is nonzero
+                _tapcount = (tapcount & ~3) | 3;
+                _delay = (_tapcount - 1) / 2;
+                ntaps = (_tapcount + 1) / 2;
+
+                int align = volk_get_alignment();
+
+                taps = (float *)volk_malloc(ntaps * sizeof(float), align);
+                for (int i = 0; i < ntaps; i++) {
+                    int n = _delay - (i * 2);
+                    // The window is one sample longer on each side, blackman is zero at its ends and would cancel the outermost taps
+                    taps[i] = (2 / (FL_M_PI * n)) * windowfunctions::blackman((i * 2) + 1, _tapcount + 1);
+                }
+
+                int size = chunksize + _tapcount;
+                buffer = (float *)volk_malloc(size * sizeof(float), align);
+                bufferStart = &buffer[_tapcount - 1];
+                memset(buffer, 0, size * sizeof(float));
+
+                even = (float *)volk_malloc(((size / 2) + 1) * sizeof(float), align);
+                odd = (float *)volk_malloc(((size / 2) + 1) * sizeof(float), align);
+                imag = (float *)volk_malloc(chunksize * sizeof(float), align);
+            }
+
+            ~hilbertFIR() {
+                volk_free(taps);
+                volk_free(buffer);
+                volk_free(even);
+                volk_free(odd);
+                volk_free(imag);
+            }
+
+            // Same interface as fftbrickwallhilbert
+            void processSamples(int count, float *inf, std::complex<float> *out) {
+                DSP_INSTRUMENT("filters::hilbertFIR", count);
+                memcpy(bufferStart, inf, count * sizeof(float));
+
+                int total = (_tapcount - 1) + count;
+                volk_32fc_deinterleave_32f_x2(even, odd, (lv_32fc_t *)buffer, total / 2);
+                if (total % 2) {
+                    even[total / 2] = buffer[total - 1];
+                }
+
+                for (int i = 0; i < count; i++) {
+                    if (i % 2) {
+                        volk_32f_x2_dot_prod_32f(&imag[i], &odd[i / 2], taps, ntaps);
+                    } else {
+                        volk_32f_x2_dot_prod_32f(&imag[i], &even[i / 2], taps, ntaps);
+                    }
                 }
-                memmove(buffer, &buffer[count], (_taps.size() - 1) * sizeof(float));
+
+                // Real part is the input delayed to the center of the filter
+                volk_32f_x2_interleave_32fc((lv_32fc_t *)out, &buffer[_delay], imag, count);
+
+                memmove(buffer, &buffer[count], (_tapcount - 1) * sizeof(float));
             }
 
         private:
-            std::vector<float> _taps;
+            int _tapcount;
+            int _delay;
+            int ntaps; // nonzero taps only
+            float *taps;
             float *buffer;
             float *bufferStart;
+            float *even;
+            float *odd;
+            float *imag;
         };
     }
 }
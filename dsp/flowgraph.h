@@ -0,0 +1,413 @@
+#pragma once
+#include "demodulator.h"
+#include "fftfilters.h"
+#include "firfilters.h"
+#include "gain.h"
+#include "mixer.h"
+#include "modulator.h"
+#include "resamplers.h"
+#include "ringbuffer.h"
+#include "timing.h"
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// Every block runs on its own thread, blocks are connected by lock-free single producer/single consumer streams
+namespace dsp::flowgraph {
+    template <class T>
+    class stream {
+    public:
+        stream(size_t capacity) : ring(capacity) {}
+
+        ~stream() {}
+
+        size_t capacity() {
+            return ring.capacity();
+        }
+
+        // Blocks until everything is written, or drops the rest once the stream is stopped
+        void write(const T *data, size_t count) {
+            int spins = 0;
+            while (count > 0 && !isStopped()) {
+                size_t n = ring.write(data, count);
+                data += n;
+                count -= n;
+                if (n == 0) {
+                    wait(spins);
+                } else {
+                    spins = 0;
+                }
+            }
+        }
+
+        // Blocks until count items are there, returns less only once the stream is finished and empty. Returns 0 once stopped.
+        // count can't be more than the capacity, it would never be available
+        size_t read(T *data, size_t count) {
+            assert(count <= ring.capacity());
+            int spins = 0;
+            while (ring.readAvailable() < count) {
+                if (isStopped()) {
+                    return 0;
+                }
+                if (finished.load(std::memory_order_acquire)) {
+                    // Writer is done, whatever is left now is all there will ever be
+                    return ring.read(data, count);
+                }
+                wait(spins);
+            }
+            return ring.read(data, count);
+        }
+
+        // Called by the writer once there is no more data
+        void finish() {
+            finished.store(true, std::memory_order_release);
+        }
+
+        // Makes both ends give up, blocked reads and writes return and anything still in the stream is dropped
+        void stop() {
+            stopped.store(true, std::memory_order_release);
+        }
+
+        bool isStopped() {
+            return stopped.load(std::memory_order_acquire);
+        }
+
+    private:
+        // Spin for a bit before starting to sleep, keeps latency low without burning a core on an idle stream
+        void wait(int &spins) {
+            if (spins++ < 64) {
+                std::this_thread::yield();
+            } else {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        }
+
+        buffer::spscRingBuffer<T> ring;
+        std::atomic<bool> finished = false;
+        std::atomic<bool> stopped = false;
+    };
+
+    class block {
+    public:
+        virtual ~block() {}
+
+        void start() {
+            worker = std::thread(&block::run, this);
+        }
+
+        void join() {
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+
+        // Stops the streams the block is connected to, which makes run() return
+        virtual void stop() = 0;
+
+    protected:
+        virtual void run() = 0;
+
+    private:
+        std::thread worker;
+    };
+
+    // process gets chunkSize input samples (less at the end of the stream) and returns the amount of output samples it wrote
+    template <class IN, class OUT>
+    class node : public block {
+    public:
+        using processFunc = std::function<int(IN *in, int count, OUT *out)>;
+
+        node(stream<IN> *in, stream<OUT> *out, int chunkSize, int maxOutSamples, processFunc process) {
+            assert((size_t)chunkSize <= in->capacity());
+            _in = in;
+            _out = out;
+            _chunkSize = chunkSize;
+            _process = process;
+            inBuffer.resize(chunkSize);
+            outBuffer.resize(maxOutSamples);
+        }
+
+        void stop() override {
+            _in->stop();
+            _out->stop();
+        }
+
+    protected:
+        void run() override {
+            while (true) {
+                int count = _in->read(inBuffer.data(), _chunkSize);
+                if (count == 0) {
+                    break;
+                }
+                int outCount = _process(inBuffer.data(), count, outBuffer.data());
+                _out->write(outBuffer.data(), outCount);
+                if (count < _chunkSize) {
+                    break;
+                }
+            }
+            _out->finish();
+        }
+
+    private:
+        stream<IN> *_in;
+        stream<OUT> *_out;
+        int _chunkSize;
+        processFunc _process;
+        std::vector<IN> inBuffer;
+        std::vector<OUT> outBuffer;
+    };
+
+    // generate fills up to maxOutSamples and returns how many it wrote, 0 ends the stream
+    template <class OUT>
+    class source : public block {
+    public:
+        using generateFunc = std::function<int(OUT *out, int max)>;
+
+        source(stream<OUT> *out, int maxOutSamples, generateFunc generate) {
+            _out = out;
+            _generate = generate;
+            outBuffer.resize(maxOutSamples);
+        }
+
+        void stop() override {
+            _out->stop();
+        }
+
+    protected:
+        void run() override {
+            int count;
+            while (!_out->isStopped() && (count = _generate(outBuffer.data(), outBuffer.size())) > 0) {
+                _out->write(outBuffer.data(), count);
+            }
+            _out->finish();
+        }
+
+    private:
+        stream<OUT> *_out;
+        generateFunc _generate;
+        std::vector<OUT> outBuffer;
+    };
+
+    template <class IN>
+    class sink : public block {
+    public:
+        using consumeFunc = std::function<void(IN *in, int count)>;
+
+        sink(stream<IN> *in, int chunkSize, consumeFunc consume) {
+            assert((size_t)chunkSize <= in->capacity());
+            _in = in;
+            _consume = consume;
+            inBuffer.resize(chunkSize);
+        }
+
+        void stop() override {
+            _in->stop();
+        }
+
+    protected:
+        void run() override {
+            int count;
+            while ((count = _in->read(inBuffer.data(), inBuffer.size())) > 0) {
+                _consume(inBuffer.data(), count);
+                if (count < (int)inBuffer.size()) {
+                    break;
+                }
+            }
+        }
+
+    private:
+        stream<IN> *_in;
+        consumeFunc _consume;
+        std::vector<IN> inBuffer;
+    };
+
+    // Owns the blocks, starts them all and waits for the streams to drain. Destroying it stops whatever is still running,
+    // call wait() first to let finite sources drain
+    class flowgraph {
+    public:
+        ~flowgraph() {
+            stop();
+            for (block *b : blocks) {
+                delete b;
+            }
+        }
+
+        template <class B>
+        B *add(B *b) {
+            blocks.push_back(b);
+            return b;
+        }
+
+        void start() {
+            for (block *b : blocks) {
+                b->start();
+            }
+        }
+
+        void wait() {
+            for (block *b : blocks) {
+                b->join();
+            }
+        }
+
+        // Tears the graph down without waiting for the sources to end, needed for sources that never do
+        void stop() {
+            for (block *b : blocks) {
+                b->stop();
+            }
+            wait();
+        }
+
+    private:
+        std::vector<block *> blocks;
+    };
+
+    // Adapters that turn the existing blocks into node process functions. The wrapped block has to outlive the node
+    namespace adapters {
+        template <class T, class TAP_T, int NTAPS>
+        auto wrap(filters::FIR<T, TAP_T, NTAPS> &f) {
+            return [&f](T *in, int count, typename filters::FIR<T, TAP_T, NTAPS>::out_t *out) {
+                f.run(in, out, count);
+                return count;
+            };
+        }
+
+        template <class T>
+        auto wrap(filters::fftFIRfilter<T> &f) {
+            return [&f](T *in, int count, T *out) {
+                f.run(in, out, count);
+                return count;
+            };
+        }
+
+        template <class T>
+        auto wrap(filters::autoFIRfilter<T> &f) {
+            return [&f](T *in, int count, T *out) {
+                f.run(in, out, count);
+                return count;
+            };
+        }
+
+        template <class T>
+        auto wrap(resamplers::interpolator<T> &r) {
+            return [&r](T *in, int count, T *out) { return r.process(in, out, count); };
+        }
+
+        template <class T>
+        auto wrap(resamplers::decimator<T> &r) {
+            return [&r](T *in, int count, T *out) { return r.process(in, out, count); };
+        }
+
+        template <class T>
+        auto wrap(resamplers::halfbandDecimatorCascade<T> &r) {
+            return [&r](T *in, int count, T *out) { return r.process(in, out, count); };
+        }
+
+        template <class T>
+        auto wrap(resamplers::halfbandInterpolatorCascade<T> &r) {
+            return [&r](T *in, int count, T *out) { return r.process(in, out, count); };
+        }
+
+        template <class T>
+        auto wrap(resamplers::cicDecimator<T> &r) {
+            return [&r](T *in, int count, T *out) { return r.process(in, out, count); };
+        }
+
+        template <class T>
+        auto wrap(resamplers::cicInterpolator<T> &r) {
+            return [&r](T *in, int count, T *out) { return r.process(in, out, count); };
+        }
+
+        inline auto wrap(resamplers::realUpsampler &r) {
+            return [&r](float *in, int count, float *out) {
+                r.upsample(count, in, out);
+                return r.calcOutSamples(count);
+            };
+        }
+
+        inline auto wrap(resamplers::realDownsampler &r) {
+            return [&r](float *in, int count, float *out) { return r.downsample(count, in, out); };
+        }
+
+        inline auto wrap(resamplers::PSK_PulseShaping_CCRationalResamplerBlock &r) {
+            return [&r](std::complex<float> *in, int count, std::complex<float> *out) {
+                r.process(in, out, count);
+                return r.calcOutSamples(count);
+            };
+        }
+
+        inline auto wrap(gain::agc &g) {
+            return [&g](float *in, int count, float *out) {
+                g.process(in, out, count);
+                return count;
+            };
+        }
+
+        inline auto wrap(gain::ragc &g) {
+            return [&g](float *in, int count, float *out) {
+                g.process(in, out, count);
+                return count;
+            };
+        }
+
+        inline auto wrap(gain::cagc &g) {
+            return [&g](std::complex<float> *in, int count, std::complex<float> *out) {
+                g.process(in, out, count);
+                return count;
+            };
+        }
+
+        inline auto wrap(mixer::real_mixer &m) {
+            return [&m](float *in, int count, float *out) {
+                m.run(out, in, count);
+                return count;
+            };
+        }
+
+        inline auto wrap(mixer::complex_mixer &m) {
+            return [&m](std::complex<float> *in, int count, std::complex<float> *out) {
+                m.run(out, in, count);
+                return count;
+            };
+        }
+
+        // Modulators take raw bytes
+        inline auto wrap(modulator::r2FSKmodulator &m) {
+            return [&m](char *in, int count, float *out) {
+                m.process(in, count, out);
+                return m.calcOutSamples(count);
+            };
+        }
+
+        inline auto wrap(modulator::cQPSKmodulator &m) {
+            return [&m](char *in, int count, std::complex<float> *out) {
+                m.process(in, count, out);
+                return m.calcOutSamples(count);
+            };
+        }
+
+        template <class T>
+        auto wrap(timing::symbolSync<T> &s) {
+            return [&s](T *in, int count, T *out) { return s.process(in, out, count); };
+        }
+
+        inline auto wrap(demodulator::quadratureDemod &d) {
+            return [&d](std::complex<float> *in, int count, float *out) { return d.process(in, out, count); };
+        }
+
+        // cpfsk writes either float or complex output, the node the lambda is passed to picks which
+        inline auto wrap(modulator::cpfskModulator &m) {
+            return [&m](char *in, int count, auto *out) { return m.process(in, count, out); };
+        }
+
+        inline auto wrap(modulator::rFSKvcogen &m) {
+            return [&m](char *in, int count, float *out) {
+                m.process(in, count, out);
+                return m.calcOutSamples(count);
+            };
+        }
+    }
+}
@@ -1,5 +1,8 @@
 #pragma once
+#include "instrumentation.h"
 #include "math.h"
+#include <algorithm>
+#include <complex>
 #include <volk/volk.h>
 
 namespace dsp {
@@ -14,6 +17,7 @@ namespace dsp {
             ~agc() {}
 
             void process(float *in, float *out, int count) {
+                DSP_INSTRUMENT("gain::agc", count);
                 // https://github.com/AlexandreRouma/SDRPlusPlus/blob/master/core/src/dsp/processing.h
                 level = pow(10, ((10.0f * log10f(level)) - (_correctedFallRate * count)) / 10.0f);
 
@@ -37,5 +41,90 @@ namespace dsp {
             float _correctedFallRate;
             float level = 0;
         };
+
+        // Per sample envelope with separate attack/decay time constants (in seconds), turns a buffer of levels into gains in place
+        class envelopeFollower {
+        public:
+            envelopeFollower(float attack, float decay, int samplerate, float maxLevel) {
+                setTimeConstants(attack, decay, samplerate);
+                _maxLevel = maxLevel;
+            }
+
+            ~envelopeFollower() {}
+
+            void setTimeConstants(float attack, float decay, int samplerate) {
+                attackCoeff = 1.0f - expf(-1.0f / (attack * samplerate));
+                decayCoeff = 1.0f - expf(-1.0f / (decay * samplerate));
+            }
+
+            void process(float *levels, int count) {
+                // Only the recursion itself is serial, the gain calculation vectorizes
+                for (int i = 0; i < count; i++) {
+                    float coeff = levels[i] > envelope ? attackCoeff : decayCoeff;
+                    envelope += coeff * (levels[i] - envelope);
+                    envelope = std::max(envelope, 10e-14f);
+                    levels[i] = envelope;
+                }
+                for (int i = 0; i < count; i++) {
+                    levels[i] = _maxLevel / levels[i];
+                }
+            }
+
+        private:
+            float _maxLevel;
+            float attackCoeff;
+            float decayCoeff;
+            float envelope = 0;
+        };
+
+        // Unlike agc the gain is updated every sample, so the behaviour doesn't depend on the chunk size
+        class ragc {
+        public:
+            ragc(float attack, float decay, int samplerate, float maxLevel) : env(attack, decay, samplerate, maxLevel) {}
+
+            ~ragc() {}
+
+            void process(float *in, float *out, int count) {
+                DSP_INSTRUMENT("gain::ragc", count);
+                for (int done = 0; done < count;) {
+                    int n = std::min(count - done, chunkSize);
+                    for (int i = 0; i < n; i++) {
+                        gains[i] = fabsf(in[done + i]);
+                    }
+                    env.process(gains, n);
+                    volk_32f_x2_multiply_32f(&out[done], &in[done], gains, n);
+                    done += n;
+                }
+            }
+
+        private:
+            static constexpr int chunkSize = 1024;
+            envelopeFollower env;
+            float gains[chunkSize];
+        };
+
+        // Magnitude based
+        class cagc {
+        public:
+            cagc(float attack, float decay, int samplerate, float maxLevel) : env(attack, decay, samplerate, maxLevel) {}
+
+            ~cagc() {}
+
+            void process(std::complex<float> *in, std::complex<float> *out, int count) {
+                DSP_INSTRUMENT("gain::cagc", count);
+                for (int done = 0; done < count;) {
+                    int n = std::min(count - done, chunkSize);
+                    volk_32fc_magnitude_32f(gains, (lv_32fc_t *)&in[done], n);
+                    env.process(gains, n);
+                    volk_32fc_32f_multiply_32fc((lv_32fc_t *)&out[done], (lv_32fc_t *)&in[done], gains, n);
+                    done += n;
+                }
+            }
+
+        private:
+            static constexpr int chunkSize = 1024;
+            envelopeFollower env;
+            float gains[chunkSize];
+        };
     }
 }
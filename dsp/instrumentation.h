@@ -0,0 +1,179 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Per block call counters and latency histograms. DSP_INSTRUMENT(name, samples) at the top of a process function times the rest of the call,
+// it expands to nothing unless SHITDSP_INSTRUMENTATION is defined. Every thread writes only its own counters (relaxed stores, no locking or
+// read-modify-write), snapshot() sums them up and can be called from any thread at any time. A block called from inside another instrumented block
+// (r2FSKmodulator running its rvco, a demodulator's decimator) isn't recorded on its own, its time and samples belong to the outermost block
+namespace dsp::instrumentation {
+    constexpr int maxBlocks = 256;
+    constexpr int histogramBuckets = 32; // bucket i counts calls that took [2^i, 2^(i + 1)) ns, the last one everything above
+
+    struct blockStats {
+        std::string name;
+        uint64_t calls = 0;
+        uint64_t samples = 0;
+        uint64_t totalNs = 0;
+        uint64_t histogram[histogramBuckets] = {};
+    };
+
+    struct counters {
+        std::atomic<uint64_t> calls{0};
+        std::atomic<uint64_t> samples{0};
+        std::atomic<uint64_t> totalNs{0};
+        std::atomic<uint64_t> histogram[histogramBuckets] = {};
+    };
+
+    struct threadCounters {
+        counters blocks[maxBlocks];
+    };
+
+    // Block names and the counters of every thread that ever recorded something. The counters of a thread that exits are kept (nothing is lost)
+    // and handed to the next new thread, so only as many sets exist as threads ever ran at the same time
+    class registry {
+    public:
+        static registry &get() {
+            static registry r;
+            return r;
+        }
+
+        // Call sites with the same name share an id, blocks past maxBlocks all end up in the last slot
+        int blockId(const char *name) {
+            std::lock_guard<std::mutex> lock(mtx);
+            for (size_t i = 0; i < names.size(); i++) {
+                if (names[i] == name) {
+                    return i;
+                }
+            }
+            if (names.size() == maxBlocks - 1) {
+                names.push_back("other");
+            }
+            if (names.size() == maxBlocks) {
+                return maxBlocks - 1;
+            }
+            names.push_back(name);
+            return names.size() - 1;
+        }
+
+        threadCounters &local() {
+            thread_local owner o;
+            if (o.c == nullptr) {
+                std::lock_guard<std::mutex> lock(mtx);
+                if (!unused.empty()) {
+                    o.c = unused.back();
+                    unused.pop_back();
+                } else {
+                    threads.push_back(std::make_unique<threadCounters>());
+                    o.c = threads.back().get();
+                }
+            }
+            return *o.c;
+        }
+
+        std::vector<blockStats> snapshot() {
+            std::lock_guard<std::mutex> lock(mtx);
+            std::vector<blockStats> stats(names.size());
+            for (size_t i = 0; i < names.size(); i++) {
+                stats[i].name = names[i];
+                for (auto &t : threads) {
+                    counters &c = t->blocks[i];
+                    stats[i].calls += c.calls.load(std::memory_order_relaxed);
+                    stats[i].samples += c.samples.load(std::memory_order_relaxed);
+                    stats[i].totalNs += c.totalNs.load(std::memory_order_relaxed);
+                    for (int b = 0; b < histogramBuckets; b++) {
+                        stats[i].histogram[b] += c.histogram[b].load(std::memory_order_relaxed);
+                    }
+                }
+            }
+            return stats;
+        }
+
+    private:
+        registry() {}
+
+        // Gives the counters back when its thread exits
+        struct owner {
+            threadCounters *c = nullptr;
+
+            ~owner() {
+                if (c != nullptr) {
+                    registry &r = registry::get();
+                    std::lock_guard<std::mutex> lock(r.mtx);
+                    r.unused.push_back(c);
+                }
+            }
+        };
+
+        std::mutex mtx;
+        std::vector<std::string> names;
+        std::vector<std::unique_ptr<threadCounters>> threads;
+        std::vector<threadCounters *> unused;
+    };
+
+    inline std::vector<blockStats> snapshot() {
+        return registry::get().snapshot();
+    }
+
+    // Only the owning thread writes, so a relaxed load and store is enough
+    inline void add(std::atomic<uint64_t> &counter, uint64_t value) {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    // Only the outermost scope on a thread records, nested ones don't even read the clock
+    class scope {
+    public:
+        scope(int id, uint64_t samples) {
+            outermost = depth()++ == 0;
+            if (!outermost) {
+                return;
+            }
+            _id = id;
+            _samples = samples;
+            start = std::chrono::steady_clock::now();
+        }
+
+        ~scope() {
+            depth()--;
+            if (!outermost) {
+                return;
+            }
+            uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            int bucket = 0;
+            while (bucket < histogramBuckets - 1 && (ns >> (bucket + 1)) != 0) {
+                bucket++;
+            }
+
+            counters &c = registry::get().local().blocks[_id];
+            add(c.calls, 1);
+            add(c.samples, _samples);
+            add(c.totalNs, ns);
+            add(c.histogram[bucket], 1);
+        }
+
+    private:
+        static int &depth() {
+            thread_local int d = 0;
+            return d;
+        }
+
+        bool outermost;
+        int _id;
+        uint64_t _samples;
+        std::chrono::steady_clock::time_point start;
+    };
+}
+
+#ifdef SHITDSP_INSTRUMENTATION
+#define DSP_INSTRUMENT(name, samples)                                                       \
+    static const int _dspInstrumentationId = dsp::instrumentation::registry::get().blockId(name); \
+    dsp::instrumentation::scope _dspInstrumentationScope(_dspInstrumentationId, samples)
+#else
+#define DSP_INSTRUMENT(name, samples)
+#endif
@@ -1,5 +1,10 @@
 #pragma once
+#include "instrumentation.h"
+#include "nco.h"
+#include <algorithm>
 #include <cmath>
+#include <complex>
+#include <volk/volk.h>
 
 namespace dsp::mixer {
     class real_mixer {
@@ -11,20 +16,51 @@ namespace dsp::mixer {
         ~real_mixer() {}
 
         void change_frequency(float frequency, float samplerate) {
-            _time = 1 / samplerate;
-            _frequency = frequency;
+            osc.changeFrequency(frequency, samplerate);
         }
 
         void run(float *out, float *in, size_t count) {
-            for (size_t i = 0; i < count; i++) {
-                out[i] = in[i] * (sin(fmod(2 * M_PI * (_time * _count) * _frequency, 2 * M_PI)));
-                _count++;
+            DSP_INSTRUMENT("mixer::real_mixer", count);
+            for (size_t done = 0; done < count;) {
+                int n = std::min(count - done, (size_t)chunkSize);
+                osc.generateSin(lo, n);
+                volk_32f_x2_multiply_32f(&out[done], &in[done], lo, n);
+                done += n;
             }
         }
 
     private:
-        size_t _count = 0;
-        double _time;
-        double _frequency;
+        static constexpr int chunkSize = 1024;
+        nco::nco osc;
+        float lo[chunkSize];
+    };
+
+    // Shifts the spectrum up by frequency, the local oscillator comes from the same fixed point NCO as real_mixer so the phase never drifts
+    class complex_mixer {
+    public:
+        complex_mixer(float frequency, float samplerate) {
+            change_frequency(frequency, samplerate);
+        }
+
+        ~complex_mixer() {}
+
+        void change_frequency(float frequency, float samplerate) {
+            osc.changeFrequency(frequency, samplerate);
+        }
+
+        void run(std::complex<float> *out, std::complex<float> *in, size_t count) {
+            DSP_INSTRUMENT("mixer::complex_mixer", count);
+            for (size_t done = 0; done < count;) {
+                int n = std::min(count - done, (size_t)chunkSize);
+                osc.generate(lo, n);
+                volk_32fc_x2_multiply_32fc((lv_32fc_t *)&out[done], (lv_32fc_t *)&in[done], (lv_32fc_t *)lo, n);
+                done += n;
+            }
+        }
+
+    private:
+        static constexpr int chunkSize = 1024;
+        nco::nco osc;
+        std::complex<float> lo[chunkSize];
     };
 }
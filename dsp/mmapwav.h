@@ -0,0 +1,220 @@
+#pragma once
+#include "convert.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// POSIX only, kept out of wav.h so the stream based reader and writers build everywhere
+namespace dsp::wav {
+    // Maps the whole file and reads straight out of the mapping, the RIFF chunks are parsed instead of assuming a 44 byte header.
+    // A sample here is one value per channel (so one IQ pair for IQ recordings)
+    class mmapWavReader {
+    public:
+        mmapWavReader(std::string path) {
+            fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                return;
+            }
+            struct stat st;
+            if (fstat(fd, &st) != 0 || st.st_size < 12) {
+                close();
+                return;
+            }
+            fileSize = st.st_size;
+            file = (const uint8_t *)mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+            if (file == MAP_FAILED) {
+                file = nullptr;
+                close();
+                return;
+            }
+            madvise((void *)file, fileSize, MADV_SEQUENTIAL);
+            headerValid = parseChunks();
+        }
+
+        mmapWavReader(const mmapWavReader &) = delete;
+        mmapWavReader &operator=(const mmapWavReader &) = delete;
+
+        ~mmapWavReader() {
+            close();
+        }
+
+        bool isFileOpen() {
+            return file != nullptr;
+        }
+
+        bool isHeaderValid() {
+            return headerValid;
+        }
+
+        uint32_t getSamplerate() {
+            return sampleRate;
+        }
+
+        uint16_t getBitDepth() {
+            return bitDepth;
+        }
+
+        uint16_t getChannelCount() {
+            return channelCount;
+        }
+
+        // 1 = integer PCM, 3 = IEEE float
+        uint16_t getSampleType() {
+            return sampleType;
+        }
+
+        uint64_t getSampleCount() {
+            return sampleCount;
+        }
+
+        // Returns false if sample is past the end
+        bool seek(uint64_t sample) {
+            if (sample > sampleCount) {
+                return false;
+            }
+            position = sample;
+            return true;
+        }
+
+        uint64_t tell() {
+            return position;
+        }
+
+        void jumpToStart() {
+            position = 0;
+        }
+
+        // Direct view into the mapping, T has to match the file format (float, int16_t, ...)
+        template <class T>
+        const T *getData(uint64_t sample = 0) {
+            return (const T *)&data[sample * bytesPerSample];
+        }
+
+        // nullptr unless the file is 32-bit float
+        const float *getFloatData(uint64_t sample = 0) {
+            if (sampleType != 3 || bitDepth != 32) {
+                return nullptr;
+            }
+            return getData<float>(sample);
+        }
+
+        // Converts up to count samples (count * channels values) from the current position into samples, returns the amount of samples read
+        size_t readFloat(float *samples, size_t count) {
+            count = std::min((uint64_t)count, sampleCount - position);
+            size_t values = count * channelCount;
+            convert::format fmt;
+            if (!convert::fromWavFormat(sampleType, bitDepth, fmt)) {
+                return 0;
+            }
+            convert::toFloat(fmt, &data[position * bytesPerSample], samples, values);
+
+            position += count;
+            return count;
+        }
+
+        void close() {
+            if (file != nullptr) {
+                munmap((void *)file, fileSize);
+                file = nullptr;
+            }
+            if (fd >= 0) {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+
+    private:
+        uint16_t readU16(const uint8_t *p) {
+            uint16_t v;
+            memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        uint32_t readU32(const uint8_t *p) {
+            uint32_t v;
+            memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        bool parseChunks() {
+            // RF64 and BW64 are RIFF with the sizes over 4GB stored in a ds64 chunk
+            bool rf64 = memcmp(file, "RF64", 4) == 0 || memcmp(file, "BW64", 4) == 0;
+            if ((memcmp(file, "RIFF", 4) != 0 && !rf64) || memcmp(&file[8], "WAVE", 4) != 0) {
+                return false;
+            }
+            uint64_t ds64DataSize = 0;
+
+            bool haveFormat = false;
+            size_t offset = 12;
+            while (offset + 8 <= fileSize) {
+                const uint8_t *chunk = &file[offset];
+                uint64_t chunkSize = readU32(&chunk[4]);
+                const uint8_t *body = &chunk[8];
+                bool truncated = chunkSize > fileSize - (offset + 8);
+
+                // Everything but the data chunk is read from its body, so it has to be inside the mapping
+                if (truncated && memcmp(chunk, "data", 4) != 0) {
+                    return false;
+                }
+
+                if (memcmp(chunk, "ds64", 4) == 0 && chunkSize >= 16) {
+                    ds64DataSize = readU32(&body[8]) | ((uint64_t)readU32(&body[12]) << 32);
+                } else if (memcmp(chunk, "fmt ", 4) == 0 && chunkSize >= 16) {
+                    sampleType = readU16(&body[0]);
+                    channelCount = readU16(&body[2]);
+                    sampleRate = readU32(&body[4]);
+                    bytesPerSample = readU16(&body[12]);
+                    bitDepth = readU16(&body[14]);
+                    // WAVE_FORMAT_EXTENSIBLE, the actual format is in the first two bytes of the sub format GUID
+                    if (sampleType == 0xFFFE && chunkSize >= 26) {
+                        sampleType = readU16(&body[24]);
+                    }
+                    haveFormat = true;
+                } else if (memcmp(chunk, "data", 4) == 0) {
+                    if (rf64 && chunkSize == 0xFFFFFFFF) {
+                        chunkSize = ds64DataSize;
+                    }
+                    // Recorders that never finished the header leave the size at 0 or garbage, use whatever is in the file then
+                    uint64_t available = fileSize - (offset + 8);
+                    if (chunkSize == 0 || chunkSize > available) {
+                        chunkSize = available;
+                    }
+                    data = body;
+                    dataSize = chunkSize;
+                    break;
+                }
+
+                // Chunks are padded to an even size
+                offset += 8 + chunkSize + (chunkSize & 1);
+            }
+
+            if (!haveFormat || data == nullptr || bytesPerSample == 0) {
+                return false;
+            }
+            sampleCount = dataSize / bytesPerSample;
+            return true;
+        }
+
+        int fd = -1;
+        const uint8_t *file = nullptr;
+        size_t fileSize = 0;
+
+        const uint8_t *data = nullptr;
+        uint64_t dataSize = 0;
+
+        uint16_t sampleType = 0;
+        uint16_t channelCount = 0;
+        uint32_t sampleRate = 0;
+        uint16_t bytesPerSample = 0;
+        uint16_t bitDepth = 0;
+
+        bool headerValid = false;
+        uint64_t sampleCount = 0;
+        uint64_t position = 0;
+    };
+}
@@ -1,8 +1,14 @@
 #pragma once
+#include "constellation.h"
 #include "firfilters.h"
+#include "instrumentation.h"
 #include "math.h"
+#include "nco.h"
+#include "resamplers.h"
 #include "vco.h"
 #include <complex>
+#include <cstring>
+#include <vector>
 
 namespace dsp::modulator {
     class r2FSKmodulator {
@@ -28,6 +34,7 @@ namespace dsp::modulator {
 
         // Expects raw bytes on the input
         void process(char *in, int inCount, float *out) {
+            DSP_INSTRUMENT("modulator::r2FSKmodulator", inCount);
             for (int i = 0; i < inCount; i++) {
                 sampleBuffer = &out[i * (8 * symbolSamples)];
                 for (int j = 0; j < 8; j++) {
@@ -50,9 +57,158 @@ namespace dsp::modulator {
         unsigned int symbolSamples = 0; // the output baudrate may change slightly depending on what baudrate-samplerate combination is chosen! _this should definitely be fixed later_
     };
 
+    // Continuous phase FSK with M levels a = 2k - (M - 1), symbol value k taken LSB first from the input bytes like the other modulators.
+    // A level of 1 shifts the frequency by deviation, so the binary tones are centerFreq -+ deviation.
+    // The symbol clock is a fractional accumulator, so the baudrate is exact and a symbol lasts either floor or ceil of samplerate / baudrate samples.
+    // With bt > 0 the frequency pulse is gaussian (GFSK) and spans pulseSymbols symbols, which delays the output by about pulseSymbols / 2 symbols
+    class cpfskModulator {
+    public:
+        cpfskModulator(int levels, double deviation, double centerFreq, double baudrate, double samplerate, float bt = 0, int pulseSymbols = 3) {
+            _levels = levels;
+            bitsPerSymbol = constellation::log2Int(levels);
+            _pulseSymbols = bt > 0 ? pulseSymbols : 1;
+            _bt = bt;
+            history.assign(_pulseSymbols, 0);
+            changeParameters(deviation, centerFreq, baudrate, samplerate);
+
+            if (_bt > 0) {
+                calcGaussianPulse();
+            }
+        }
+
+        ~cpfskModulator() {}
+
+        void changeParameters(double deviation, double centerFreq, double baudrate, double samplerate) {
+            deviationIncrement = (deviation / samplerate) * 4294967296.0;
+            centerIncrement = nco::frequencyToPhaseIncrement(centerFreq, samplerate);
+            symbolStep = baudrate / samplerate;
+            samplesPerSymbol = samplerate / baudrate;
+        }
+
+        // Upper bound, the exact amount depends on the symbol clock and is returned by process
+        int calcOutSamples(int inCount) {
+            return (((inCount * 8) / bitsPerSymbol) + 1) * (int)ceil(samplesPerSymbol);
+        }
+
+        // Expects raw bytes on the input, returns the amount of samples written
+        int process(char *in, int inCount, float *out) {
+            return modulate(in, inCount, out);
+        }
+
+        int process(char *in, int inCount, std::complex<float> *out) {
+            return modulate(in, inCount, out);
+        }
+
+    private:
+        // The phases are accumulated serially (integer adds only), the table lookups run over whole chunks so they vectorize
+        template <class OUT_T>
+        int modulate(char *in, int inCount, OUT_T *out) {
+            DSP_INSTRUMENT("modulator::cpfskModulator", inCount);
+            int outc = 0;
+            int n = 0;
+            for (int i = 0; i < inCount; i++) {
+                bitBuffer |= (unsigned int)(unsigned char)in[i] << bitCount;
+                bitCount += 8;
+                while (bitCount >= bitsPerSymbol) {
+                    int k = bitBuffer & (_levels - 1);
+                    bitBuffer >>= bitsPerSymbol;
+                    bitCount -= bitsPerSymbol;
+
+                    memmove(&history[1], &history[0], (_pulseSymbols - 1) * sizeof(float));
+                    history[0] = (2 * k) - (_levels - 1);
+
+                    for (; symbolPhase < 1; symbolPhase += symbolStep) {
+                        phases[n++] = phase;
+                        phase += centerIncrement + (uint32_t)(int64_t)(deviationIncrement * frequency());
+                        if (n == chunkSize) {
+                            generate(&out[outc], n);
+                            outc += n;
+                            n = 0;
+                        }
+                    }
+                    symbolPhase -= 1;
+                }
+            }
+            generate(&out[outc], n);
+            return outc + n;
+        }
+
+        // Sum of the pulses of all symbols that are still active, history[j] started j + symbolPhase symbols ago
+        double frequency() {
+            if (_bt <= 0) {
+                return history[0];
+            }
+            double f = 0;
+            for (int j = 0; j < _pulseSymbols; j++) {
+                double pos = (j + symbolPhase) * pulseResolution;
+                int index = (int)pos;
+                double frac = pos - index;
+                f += history[j] * (pulse[index] + ((pulse[index + 1] - pulse[index]) * frac));
+            }
+            return f;
+        }
+
+        void generate(float *out, int count) {
+            const float *table = nco::getSineTable();
+            for (int i = 0; i < count; i++) {
+                out[i] = nco::lookupSin(table, phases[i]);
+            }
+        }
+
+        void generate(std::complex<float> *out, int count) {
+            const float *table = nco::getSineTable();
+            float *outf = (float *)out;
+            for (int i = 0; i < count; i++) {
+                outf[i * 2] = nco::lookupCos(table, phases[i]);
+                outf[(i * 2) + 1] = nco::lookupSin(table, phases[i]);
+            }
+        }
+
+        // Rectangular symbol convolved with a gaussian, normalized so one symbol always adds the same phase as it would without shaping
+        void calcGaussianPulse() {
+            int size = _pulseSymbols * pulseResolution;
+            pulse.resize(size + 1);
+            double c = (2 * M_PI * _bt) / sqrt(log(2.0));
+            double sum = 0;
+            for (int i = 0; i <= size; i++) {
+                double t = ((double)i / pulseResolution) - (_pulseSymbols / 2.0);
+                pulse[i] = 0.5 * (erfc((c * (t - 0.5)) / M_SQRT2) - erfc((c * (t + 0.5)) / M_SQRT2));
+                if (i < size) {
+                    sum += pulse[i];
+                }
+            }
+            for (int i = 0; i <= size; i++) {
+                pulse[i] *= pulseResolution / sum;
+            }
+        }
+
+        static constexpr int chunkSize = 1024;
+        static constexpr int pulseResolution = 64; // table entries per symbol
+
+        int _levels;
+        int bitsPerSymbol;
+        int _pulseSymbols;
+        float _bt;
+
+        double deviationIncrement = 0; // phase increment at a level of 1
+        uint32_t centerIncrement = 0;
+        double symbolStep = 0; // symbols per sample
+        double samplesPerSymbol = 0;
+
+        double symbolPhase = 0;
+        uint32_t phase = 0;
+        uint32_t phases[chunkSize];
+
+        std::vector<float> history;
+        std::vector<double> pulse;
+        unsigned int bitBuffer = 0;
+        int bitCount = 0;
+    };
+
     class cQPSKmodulator {
     public:
-        cQPSKmodulator(float symrate, int samplerate) {
+        // Without differential encoding every byte is mapped with a single table lookup
+        cQPSKmodulator(float symrate, int samplerate, bool differential = true) : qpskMapper(differential) {
             changeParameters(symrate, samplerate);
         }
 
@@ -69,24 +225,14 @@ namespace dsp::modulator {
 
         // Expects raw bytes on the input
         void process(char *in, int inCount, std::complex<float> *out) {
+            DSP_INSTRUMENT("modulator::cQPSKmodulator", inCount);
             int counterSamples = 0;
-            int a = 0;
+            std::complex<float> symbols[4];
             for (int i = 0; i < inCount; i++) {
+                qpskMapper.process(&in[i], 1, symbols);
                 for (int j = 0; j < 4; j++) {
-
-                    // differential encoder
-                    unsigned int newPhaseIndex = ((unsigned int)getBitPair(in[i], j) + lastPhaseIndex) % 4;
-                    lastPhaseIndex = newPhaseIndex;
-
-                    float PhaseShiftDeg = (float)phases[newPhaseIndex];
-
-                    float PhaseShiftRadians = PhaseShiftDeg * (FL_M_PI / 180);
-
-                    float reVal = cos(PhaseShiftRadians);
-                    float imVal = sin(PhaseShiftRadians);
-
                     for (int k = 0; k < symbolSamples; k++) {
-                        out[counterSamples] = {reVal, imVal};
+                        out[counterSamples] = symbols[j];
                         counterSamples++;
                     }
                 }
@@ -96,10 +242,6 @@ namespace dsp::modulator {
     private:
         unsigned int symbolSamples = 0;
 
-        unsigned char getBitPair(unsigned char in, int n) {
-            return (in >> (n * 2)) & 0x3;
-        }
-
         /*
          * +-------+-------+  +----+----+
          * | 135°  | 45°   |  | 01 | 11 |
@@ -107,8 +249,45 @@ namespace dsp::modulator {
          * | 225°  | 315°  |  | 00 | 10 |
          * +-------+-------+  +----+----+
          */
-        int phases[4] = {45, 135, 225, 315};
-        unsigned int lastPhaseIndex = 0;
+        constellation::mapper<constellation::psk<4, 45>> qpskMapper;
+    };
+
+    // Same mapping as cQPSKmodulator, but the RRC pulse shaping is done by a polyphase interpolator straight on the symbols,
+    // so there is no rectangular oversampled buffer and nothing but the output is ever at the sample rate
+    class cQPSKRRCmodulator {
+    public:
+        cQPSKRRCmodulator(int samplesPerSymbol, float alpha, int tapcount, int maxInputBytes, bool differential = true) : qpskMapper(differential) {
+            _samplesPerSymbol = samplesPerSymbol;
+
+            tapcount |= 1; // make sure tapcount is odd
+            std::vector<float> taps(tapcount);
+            // Gain of samplesPerSymbol so the interpolated symbols keep unit amplitude
+            filters::FIRcoeffcalc::root_raised_cosine(samplesPerSymbol, samplesPerSymbol, 1, alpha, tapcount, taps.data());
+
+            symbols.resize(maxInputBytes * 4);
+            interp = new resamplers::interpolator<std::complex<float>>(taps, samplesPerSymbol, maxInputBytes * 4);
+        }
+
+        ~cQPSKRRCmodulator() {
+            delete interp;
+        }
+
+        int calcOutSamples(int inCount) {
+            return ((inCount * 8) / 2) * _samplesPerSymbol;
+        }
+
+        // Expects raw bytes on the input
+        void process(char *in, int inCount, std::complex<float> *out) {
+            DSP_INSTRUMENT("modulator::cQPSKRRCmodulator", inCount);
+            int counterSymbols = qpskMapper.process(in, inCount, symbols.data());
+            interp->process(symbols.data(), out, counterSymbols);
+        }
+
+    private:
+        int _samplesPerSymbol;
+        resamplers::interpolator<std::complex<float>> *interp;
+        std::vector<std::complex<float>> symbols;
+        constellation::mapper<constellation::psk<4, 45>> qpskMapper;
     };
 
     class rFSKvcogen {
@@ -130,6 +309,7 @@ namespace dsp::modulator {
 
         // Expects raw bytes on the input
         void process(char *in, int inCount, float *out) {
+            DSP_INSTRUMENT("modulator::rFSKvcogen", inCount);
             int counterSamples = 0;
             int a = 0;
             for (int i = 0; i < inCount; i++) {
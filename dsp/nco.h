@@ -0,0 +1,98 @@
+#pragma once
+#include "math.h"
+#include <complex>
+#include <cstdint>
+
+namespace dsp::nco {
+    // Phases are unsigned 32-bit fixed point, 2^32 is one full turn so wrapping is free and the precision never degrades
+    constexpr int lutBits = 10;
+    constexpr int lutSize = 1 << lutBits;
+    constexpr int fracBits = 32 - lutBits;
+
+    // One extra entry so the interpolation never has to wrap
+    struct sineTable {
+        float values[lutSize + 1];
+
+        sineTable() {
+            for (int i = 0; i <= lutSize; i++) {
+                values[i] = sin((2 * M_PI * i) / lutSize);
+            }
+        }
+    };
+
+    inline const float *getSineTable() {
+        static sineTable table;
+        return table.values;
+    }
+
+    inline uint32_t frequencyToPhaseIncrement(double frequency, double samplerate) {
+        return (uint32_t)(int64_t)llround((frequency / samplerate) * 4294967296.0);
+    }
+
+    inline uint32_t radiansToPhase(double radians) {
+        return (uint32_t)(int64_t)llround((fmod(radians, 2 * M_PI) / (2 * M_PI)) * 4294967296.0);
+    }
+
+    // Table lookup with linear interpolation, the error stays below 5e-6
+    inline float lookupSin(const float *table, uint32_t phase) {
+        uint32_t index = phase >> fracBits;
+        float frac = (phase & ((1u << fracBits) - 1)) * (1.0f / (1u << fracBits));
+        return table[index] + ((table[index + 1] - table[index]) * frac);
+    }
+
+    inline float lookupCos(const float *table, uint32_t phase) {
+        return lookupSin(table, phase + (1u << 30));
+    }
+
+    class nco {
+    public:
+        nco() {}
+
+        nco(double frequency, double samplerate) {
+            changeFrequency(frequency, samplerate);
+        }
+
+        ~nco() {}
+
+        void changeFrequency(double frequency, double samplerate) {
+            phaseIncrement = frequencyToPhaseIncrement(frequency, samplerate);
+        }
+
+        void setPhase(double radians) {
+            phase = radiansToPhase(radians);
+        }
+
+        // The phase of every sample is computed from the start of the block, so there is no dependency between iterations and the loops vectorize
+        void generateSin(float *out, int count) {
+            const float *table = getSineTable();
+            for (int i = 0; i < count; i++) {
+                out[i] = lookupSin(table, phase + (phaseIncrement * (uint32_t)i));
+            }
+            phase += phaseIncrement * (uint32_t)count;
+        }
+
+        void generateCos(float *out, int count) {
+            const float *table = getSineTable();
+            for (int i = 0; i < count; i++) {
+                out[i] = lookupCos(table, phase + (phaseIncrement * (uint32_t)i));
+            }
+            phase += phaseIncrement * (uint32_t)count;
+        }
+
+        // e^(j * phase)
+        void generate(std::complex<float> *out, int count) {
+            const float *table = getSineTable();
+            float *outf = (float *)out;
+            for (int i = 0; i < count; i++) {
+                uint32_t p = phase + (phaseIncrement * (uint32_t)i);
+                outf[i * 2] = lookupCos(table, p);
+                outf[(i * 2) + 1] = lookupSin(table, p);
+            }
+            phase += phaseIncrement * (uint32_t)count;
+        }
+
+    private:
+        uint32_t phase = 0;
+        uint32_t phaseIncrement = 0;
+    };
+}
@@ -1,34 +1,578 @@
 #pragma once
+#include "filterdesign.h"
 #include "firfilters.h"
+#include "instrumentation.h"
+#include <algorithm>
+#include <cassert>
+#include <complex>
+#include <cstdint>
+#include <cstring>
 #include <numeric>
 
 namespace dsp {
     namespace resamplers {
+        // Polyphase interpolator, the zero stuffed samples are never multiplied so every subfilter only holds the taps that hit real input samples
+        template <class T>
+        class interpolator {
+        public:
+            interpolator(std::vector<float> taps, int interpolation, int maxInputSamples) {
+                _interpolation = interpolation;
+
+                int align = volk_get_alignment();
+
+                // Subfilters, one per output phase, padded with zeros to a multiple of the interpolation
+                ntaps = (taps.size() + _interpolation - 1) / _interpolation;
+                subtaps = (float *)volk_malloc(_interpolation * ntaps * sizeof(float), align);
+                std::fill(subtaps, &subtaps[_interpolation * ntaps], 0);
+                for (size_t i = 0; i < taps.size(); i++)
+                    subtaps[((i % _interpolation) * ntaps) + (ntaps - 1) - (i / _interpolation)] = taps[i];
+
+                // Buffer
+                buffer = (T *)volk_malloc((maxInputSamples + ntaps) * sizeof(T), align);
+                bufferStart = &buffer[ntaps - 1];
+                std::fill(buffer, &buffer[maxInputSamples + ntaps], T(0));
+            }
+
+            ~interpolator() {
+                volk_free(subtaps);
+                volk_free(buffer);
+            }
+
+            int calcOutSamples(int inCount) {
+                return inCount * _interpolation;
+            }
+
+            int process(T *in, T *out, int count) {
+                DSP_INSTRUMENT("resamplers::interpolator", count);
+                memcpy(bufferStart, in, count * sizeof(T));
+                // Subfilters are usually short, the common lengths get the unrolled kernels from the FIR template
+                switch (ntaps) {
+                case 4:
+                    filterPhases<4>(out, count);
+                    break;
+                case 8:
+                    filterPhases<8>(out, count);
+                    break;
+                case 12:
+                    filterPhases<12>(out, count);
+                    break;
+                case 16:
+                    filterPhases<16>(out, count);
+                    break;
+                case 24:
+                    filterPhases<24>(out, count);
+                    break;
+                case 32:
+                    filterPhases<32>(out, count);
+                    break;
+                default:
+                    filterPhases<0>(out, count);
+                    break;
+                }
+                memmove(buffer, &buffer[count], (ntaps - 1) * sizeof(T));
+                return count * _interpolation;
+            }
+
+        private:
+            template <int NTAPS>
+            void filterPhases(T *out, int count) {
+                for (int i = 0; i < count; i++) {
+                    for (int p = 0; p < _interpolation; p++) {
+                        if constexpr (NTAPS != 0) {
+                            filters::kernels::dotProduct<NTAPS>(&out[(i * _interpolation) + p], &buffer[i], &subtaps[p * NTAPS]);
+                        } else {
+                            filters::dotProduct(&out[(i * _interpolation) + p], &buffer[i], &subtaps[p * ntaps], ntaps);
+                        }
+                    }
+                }
+            }
+
+            int _interpolation;
+            int ntaps;
+            float *subtaps;
+            T *buffer;
+            T *bufferStart;
+        };
+
+        // Decimating FIR, only the outputs that survive the decimation are computed
+        template <class T>
+        class decimator {
+        public:
+            decimator(std::vector<float> taps, int decimation, int maxInputSamples) {
+                _decimation = decimation;
+                ntaps = taps.size();
+
+                int align = volk_get_alignment();
+
+                revtaps = (float *)volk_malloc(ntaps * sizeof(float), align);
+                for (int i = 0; i < ntaps; i++)
+                    revtaps[(ntaps - 1) - i] = taps[i];
+
+                // Buffer
+                buffer = (T *)volk_malloc((maxInputSamples + ntaps) * sizeof(T), align);
+                bufferStart = &buffer[ntaps - 1];
+                std::fill(buffer, &buffer[maxInputSamples + ntaps], T(0));
+            }
+
+            ~decimator() {
+                volk_free(revtaps);
+                volk_free(buffer);
+            }
+
+            int calcOutSamples(int inCount) {
+                return (inCount + _decimation - 1) / _decimation;
+            }
+
+            // Returns the amount of output samples, the decimation phase is kept across calls
+            int process(T *in, T *out, int count) {
+                DSP_INSTRUMENT("resamplers::decimator", count);
+                memcpy(bufferStart, in, count * sizeof(T));
+                int outc = 0;
+                int i = offset;
+                for (; i < count; i += _decimation) {
+                    filters::dotProduct(&out[outc++], &buffer[i], revtaps, ntaps);
+                }
+                offset = i - count;
+                memmove(buffer, &buffer[count], (ntaps - 1) * sizeof(T));
+                return outc;
+            }
+
+        private:
+            int _decimation;
+            int offset = 0;
+            int ntaps;
+            float *revtaps;
+            T *buffer;
+            T *bufferStart;
+        };
+
+        // Half-band lowpass with the cutoff at a quarter of the samplerate. tapcount is 4k + 3, every other tap except the center one is zero
+        // and the rest is symmetric, so a half-band stage only needs (tapcount + 1) / 4 multiplies per output
+        inline std::vector<float> halfbandTaps(int tapcount, float attenuation) {
+            tapcount = (tapcount & ~3) | 3;
+            double beta = filters::design::kaiserBeta(attenuation);
+            std::vector<float> taps(tapcount);
+            for (int i = 0; i < tapcount; i++) {
+                int x = i - (tapcount / 2);
+                if (x == 0) {
+                    taps[i] = 0.5;
+                } else if (x % 2) {
+                    taps[i] = (sin((FL_M_PI * x) / 2) / (FL_M_PI * x)) * windowfunctions::kaiser(i, tapcount - 1, beta);
+                }
+            }
+            return taps;
+        }
+
+        // Kaiser estimate for a transition width in cycles per sample, rounded up to 4k + 3
+        inline int halfbandTapcount(float transitionWidth, float attenuation) {
+            int taps = std::max((int)ceil((attenuation - 7.95) / (14.36 * transitionWidth)) + 1, 3);
+            return ((taps / 4) * 4) + 3;
+        }
+
+        // Sum of the nonzero taps of a half-band, pairs of samples that share a tap are added first
+        template <class T>
+        inline T halfbandDot(const T *in, const float *taps, int ntaps) {
+            T acc = T(0);
+            for (int j = 0; j < ntaps / 2; j++) {
+                acc += (in[j] + in[(ntaps - 1) - j]) * taps[j];
+            }
+            return acc;
+        }
+
+        // Decimation by 2. The input is split into the samples that meet the nonzero taps and the ones that meet the center tap,
+        // an odd sample at the end of a call is kept for the next one
+        template <class T>
+        class halfbandDecimator {
+        public:
+            halfbandDecimator(std::vector<float> halfband, int maxInputSamples) {
+                int tapcount = halfband.size();
+                ntaps = (tapcount + 1) / 2;
+                centerDelay = (tapcount - 3) / 4;
+
+                int align = volk_get_alignment();
+                taps = (float *)volk_malloc(ntaps * sizeof(float), align);
+                for (int j = 0; j < ntaps; j++) {
+                    taps[j] = halfband[j * 2];
+                }
+
+                int pairs = (maxInputSamples / 2) + 1;
+                tapSamples = (T *)volk_malloc((pairs + ntaps) * sizeof(T), align);
+                centerSamples = (T *)volk_malloc((pairs + centerDelay + 1) * sizeof(T), align);
+                std::fill(tapSamples, &tapSamples[pairs + ntaps], T(0));
+                std::fill(centerSamples, &centerSamples[pairs + centerDelay + 1], T(0));
+            }
+
+            ~halfbandDecimator() {
+                volk_free(taps);
+                volk_free(tapSamples);
+                volk_free(centerSamples);
+            }
+
+            int calcOutSamples(int inCount) {
+                return (inCount + 1) / 2;
+            }
+
+            // Returns the amount of output samples
+            int process(T *in, T *out, int count) {
+                DSP_INSTRUMENT("resamplers::halfbandDecimator", count);
+                T *tapStart = &tapSamples[ntaps - 1];
+                T *centerStart = &centerSamples[centerDelay];
+
+                int pairs = 0;
+                int i = 0;
+                if (pending && count > 0) {
+                    centerStart[0] = pendingSample;
+                    tapStart[0] = in[0];
+                    pairs = 1;
+                    i = 1;
+                }
+                for (; i + 1 < count; i += 2) {
+                    centerStart[pairs] = in[i];
+                    tapStart[pairs] = in[i + 1];
+                    pairs++;
+                }
+                if (i < count) {
+                    pendingSample = in[i];
+                    pending = true;
+                } else if (count > 0) {
+                    pending = false;
+                }
+
+                for (int n = 0; n < pairs; n++) {
+                    out[n] = halfbandDot(&tapSamples[n], taps, ntaps) + (centerSamples[n] * 0.5f);
+                }
+
+                memmove(tapSamples, &tapSamples[pairs], (ntaps - 1) * sizeof(T));
+                memmove(centerSamples, &centerSamples[pairs], centerDelay * sizeof(T));
+                return pairs;
+            }
+
+        private:
+            int ntaps; // nonzero taps besides the center
+            int centerDelay;
+            float *taps;
+            T *tapSamples;
+            T *centerSamples;
+            bool pending = false;
+            T pendingSample = T(0);
+        };
+
+        // Interpolation by 2, every input gives one filtered output and one delayed copy of the input
+        template <class T>
+        class halfbandInterpolator {
+        public:
+            halfbandInterpolator(std::vector<float> halfband, int maxInputSamples) {
+                int tapcount = halfband.size();
+                ntaps = (tapcount + 1) / 2;
+                centerDelay = (tapcount - 3) / 4;
+
+                int align = volk_get_alignment();
+                taps = (float *)volk_malloc(ntaps * sizeof(float), align);
+                for (int j = 0; j < ntaps; j++) {
+                    taps[j] = halfband[j * 2] * 2;
+                }
+
+                buffer = (T *)volk_malloc((maxInputSamples + ntaps) * sizeof(T), align);
+                bufferStart = &buffer[ntaps - 1];
+                std::fill(buffer, &buffer[maxInputSamples + ntaps], T(0));
+            }
+
+            ~halfbandInterpolator() {
+                volk_free(taps);
+                volk_free(buffer);
+            }
+
+            int calcOutSamples(int inCount) {
+                return inCount * 2;
+            }
+
+            int process(T *in, T *out, int count) {
+                DSP_INSTRUMENT("resamplers::halfbandInterpolator", count);
+                memcpy(bufferStart, in, count * sizeof(T));
+                for (int n = 0; n < count; n++) {
+                    out[n * 2] = halfbandDot(&buffer[n], taps, ntaps);
+                    out[(n * 2) + 1] = buffer[n + (ntaps - 1) - centerDelay];
+                }
+                memmove(buffer, &buffer[count], (ntaps - 1) * sizeof(T));
+                return count * 2;
+            }
+
+        private:
+            int ntaps;
+            int centerDelay;
+            float *taps;
+            T *buffer;
+            T *bufferStart;
+        };
+
+        // Power of two rate changes as a chain of half-band stages. passband is the part of the low rate nyquist band that has to stay clean
+        // (0.8 keeps 80%), aliasing is only kept out of that part. Only the stage at the lowest rate needs a narrow transition, the others get
+        // wider ones the higher their rate is, which keeps them down to a few taps. factor has to be a power of two and 0 < passband < 1
+        inline std::vector<std::vector<float>> halfbandCascadeTaps(int factor, float passband, float attenuation) {
+            assert(factor > 0 && (factor & (factor - 1)) == 0);
+            assert(passband > 0 && passband < 1);
+            std::vector<std::vector<float>> stages;
+            for (int rate = 1; rate < factor; rate *= 2) {
+                // Normalized to the stage input rate: passband edge at passband / 2, first alias lands at rate - passband / 2
+                float transition = (rate - passband) / (2.0f * rate);
+                stages.push_back(halfbandTaps(halfbandTapcount(transition, attenuation), attenuation));
+            }
+            return stages; // lowest rate stage first
+        }
+
+        template <class T>
+        class halfbandDecimatorCascade {
+        public:
+            halfbandDecimatorCascade(int decimation, float passband, float attenuation, int maxInputSamples) {
+                std::vector<std::vector<float>> taps = halfbandCascadeTaps(decimation, passband, attenuation);
+                int maxIn = maxInputSamples;
+                for (int i = taps.size() - 1; i >= 0; i--) {
+                    stages.push_back(new halfbandDecimator<T>(taps[i], maxIn));
+                    maxIn = (maxIn / 2) + 1;
+                }
+                int align = volk_get_alignment();
+                buffers[0] = (T *)volk_malloc(((maxInputSamples / 2) + 1) * sizeof(T), align);
+                buffers[1] = (T *)volk_malloc(((maxInputSamples / 2) + 1) * sizeof(T), align);
+            }
+
+            ~halfbandDecimatorCascade() {
+                for (halfbandDecimator<T> *s : stages) {
+                    delete s;
+                }
+                volk_free(buffers[0]);
+                volk_free(buffers[1]);
+            }
+
+            // Upper bound, odd samples wait for their pair
+            int calcOutSamples(int inCount) {
+                int n = inCount;
+                for (size_t i = 0; i < stages.size(); i++) {
+                    n = (n + 1) / 2;
+                }
+                return n;
+            }
+
+            // Returns the amount of output samples
+            int process(T *in, T *out, int count) {
+                T *src = in;
+                for (size_t i = 0; i < stages.size(); i++) {
+                    T *dst = i == stages.size() - 1 ? out : buffers[i % 2];
+                    count = stages[i]->process(src, dst, count);
+                    src = dst;
+                }
+                return count;
+            }
+
+        private:
+            std::vector<halfbandDecimator<T> *> stages;
+            T *buffers[2];
+        };
+
+        template <class T>
+        class halfbandInterpolatorCascade {
+        public:
+            halfbandInterpolatorCascade(int interpolation, float passband, float attenuation, int maxInputSamples) {
+                std::vector<std::vector<float>> taps = halfbandCascadeTaps(interpolation, passband, attenuation);
+                int maxIn = maxInputSamples;
+                for (size_t i = 0; i < taps.size(); i++) {
+                    stages.push_back(new halfbandInterpolator<T>(taps[i], maxIn));
+                    maxIn *= 2;
+                }
+                int align = volk_get_alignment();
+                buffers[0] = (T *)volk_malloc(maxIn * sizeof(T), align);
+                buffers[1] = (T *)volk_malloc(maxIn * sizeof(T), align);
+            }
+
+            ~halfbandInterpolatorCascade() {
+                for (halfbandInterpolator<T> *s : stages) {
+                    delete s;
+                }
+                volk_free(buffers[0]);
+                volk_free(buffers[1]);
+            }
+
+            int calcOutSamples(int inCount) {
+                return inCount << stages.size();
+            }
+
+            int process(T *in, T *out, int count) {
+                T *src = in;
+                for (size_t i = 0; i < stages.size(); i++) {
+                    T *dst = i == stages.size() - 1 ? out : buffers[i % 2];
+                    count = stages[i]->process(src, dst, count);
+                    src = dst;
+                }
+                return count;
+            }
+
+        private:
+            std::vector<halfbandInterpolator<T> *> stages;
+            T *buffers[2];
+        };
+
+        // Cascaded integrator comb filters, no multiplies besides the conversion to and from fixed point. Input samples of up to 1.0 are scaled to
+        // fixed point with as many bits as the bit growth of (rate * differentialDelay)^order leaves in 64 bits (at most 24, the float precision).
+        // The registers wrap in two's complement, which gives the exact result as long as the output fits, so the integrators never need to be reset.
+        // The output has unity DC gain, use FIRcoeffcalc::cicCompensation to flatten the passband droop
+        inline int cicInputBits(int rate, int order, int differentialDelay) {
+            int growth = (int)ceil(order * log2((double)rate * differentialDelay));
+            return std::max(std::min(24, 62 - growth), 1);
+        }
+
+        template <class T>
+        class cicDecimator {
+        public:
+            cicDecimator(int decimation, int order, int differentialDelay = 1) {
+                _decimation = decimation;
+                _order = order;
+                _differentialDelay = differentialDelay;
+                inputScale = ldexp(1.0, cicInputBits(decimation, order, differentialDelay));
+                outputScale = 1 / (inputScale * pow((double)decimation * differentialDelay, order));
+
+                integrators.assign(order * lanes, 0);
+                combs.assign(order * differentialDelay * lanes, 0);
+            }
+
+            int calcOutSamples(int inCount) {
+                return (inCount + _decimation - 1) / _decimation;
+            }
+
+            // Returns the amount of output samples, the decimation phase is kept across calls
+            int process(T *in, T *out, int count) {
+                DSP_INSTRUMENT("resamplers::cicDecimator", count);
+                float *inf = (float *)in;
+                float *outf = (float *)out;
+                int outc = 0;
+                for (int i = 0; i < count; i++) {
+                    for (int l = 0; l < lanes; l++) {
+                        uint64_t acc = (uint64_t)(int64_t)llrint(inf[(i * lanes) + l] * inputScale);
+                        for (int s = 0; s < _order; s++) {
+                            integrators[(s * lanes) + l] += acc;
+                            acc = integrators[(s * lanes) + l];
+                        }
+                    }
+
+                    if (++phase < _decimation) {
+                        continue;
+                    }
+                    phase = 0;
+
+                    for (int l = 0; l < lanes; l++) {
+                        uint64_t acc = integrators[((_order - 1) * lanes) + l];
+                        for (int s = 0; s < _order; s++) {
+                            uint64_t &delayed = combs[(((s * _differentialDelay) + combIndex) * lanes) + l];
+                            uint64_t diff = acc - delayed;
+                            delayed = acc;
+                            acc = diff;
+                        }
+                        outf[(outc * lanes) + l] = (double)(int64_t)acc * outputScale;
+                    }
+                    combIndex = (combIndex + 1) % _differentialDelay;
+                    outc++;
+                }
+                return outc;
+            }
+
+        private:
+            static constexpr int lanes = sizeof(T) / sizeof(float);
+
+            int _decimation;
+            int _order;
+            int _differentialDelay;
+            double inputScale;
+            double outputScale;
+
+            int phase = 0;
+            int combIndex = 0;
+            std::vector<uint64_t> integrators;
+            std::vector<uint64_t> combs; // differentialDelay samples per stage, oldest at combIndex
+        };
+
+        // Combs at the input rate, then zero stuffing and the integrators at the output rate
+        template <class T>
+        class cicInterpolator {
+        public:
+            cicInterpolator(int interpolation, int order, int differentialDelay = 1) {
+                _interpolation = interpolation;
+                _order = order;
+                _differentialDelay = differentialDelay;
+                inputScale = ldexp(1.0, cicInputBits(interpolation, order, differentialDelay));
+                outputScale = interpolation / (inputScale * pow((double)interpolation * differentialDelay, order));
+
+                integrators.assign(order * lanes, 0);
+                combs.assign(order * differentialDelay * lanes, 0);
+            }
+
+            int calcOutSamples(int inCount) {
+                return inCount * _interpolation;
+            }
+
+            int process(T *in, T *out, int count) {
+                DSP_INSTRUMENT("resamplers::cicInterpolator", count);
+                float *inf = (float *)in;
+                float *outf = (float *)out;
+                for (int i = 0; i < count; i++) {
+                    for (int l = 0; l < lanes; l++) {
+                        uint64_t acc = (uint64_t)(int64_t)llrint(inf[(i * lanes) + l] * inputScale);
+                        for (int s = 0; s < _order; s++) {
+                            uint64_t &delayed = combs[(((s * _differentialDelay) + combIndex) * lanes) + l];
+                            uint64_t diff = acc - delayed;
+                            delayed = acc;
+                            acc = diff;
+                        }
+
+                        // Only the first of every interpolation outputs sees the comb output, the rest are zeros
+                        for (int p = 0; p < _interpolation; p++) {
+                            uint64_t v = p == 0 ? acc : 0;
+                            for (int s = 0; s < _order; s++) {
+                                integrators[(s * lanes) + l] += v;
+                                v = integrators[(s * lanes) + l];
+                            }
+                            outf[(((i * _interpolation) + p) * lanes) + l] = (double)(int64_t)v * outputScale;
+                        }
+                    }
+                    combIndex = (combIndex + 1) % _differentialDelay;
+                }
+                return count * _interpolation;
+            }
+
+        private:
+            static constexpr int lanes = sizeof(T) / sizeof(float);
+
+            int _interpolation;
+            int _order;
+            int _differentialDelay;
+            double inputScale;
+            double outputScale;
+
+            int combIndex = 0;
+            std::vector<uint64_t> integrators;
+            std::vector<uint64_t> combs;
+        };
+
         class realUpsampler {
         public:
             realUpsampler(int chunkSize, int multiplier, int taps) {
                 _multiplier = multiplier;
                 _chunkSize = chunkSize;
                 std::vector<float> coeffs = filters::FIRcoeffcalc::calcCoeffs(dsp::filters::FIRcoeffcalc::lowpass, taps, 48000, 24000 * ((float)1 / multiplier));
-                lpf = new filters::FIRfilter(coeffs, _chunkSize * multiplier);
-                processarr = (float *)malloc(chunkSize * _multiplier * sizeof(float));
+                interp = new interpolator<float>(coeffs, _multiplier, _chunkSize);
             }
 
             ~realUpsampler() {
-                free(processarr);
-                delete lpf;
+                delete interp;
+            }
+
+            int calcOutSamples(int inCount) {
+                return inCount * _multiplier;
             }
 
             void upsample(int incount, float *in, float *out) {
-                for (long int i = 0; i < incount; i++) {
-                    processarr[i * _multiplier] = in[i];
-                }
-                lpf->run(processarr, out, incount * _multiplier);
+                interp->process(in, out, incount);
             }
 
         private:
-            filters::FIRfilter *lpf;
-            float *processarr;
+            interpolator<float> *interp;
             int _multiplier;
             int _chunkSize;
         };
@@ -37,49 +581,22 @@ namespace dsp {
             complexUpsampler(int chunkSize, int multiplier, int taps) {
                 _chunkSize = chunkSize;
                 _multiplier = multiplier;
-
-                realInArr = (float *)calloc(_chunkSize, sizeof(float));
-                imagInArr = (float *)calloc(_chunkSize, sizeof(float));
-
-                realOutArr = (float *)malloc(_chunkSize * _multiplier * sizeof(float));
-                imagOutArr = (float *)malloc(_chunkSize * _multiplier * sizeof(float));
-
-                upReal = new resamplers::realUpsampler(_multiplier, _chunkSize, taps);
-                upImag = new resamplers::realUpsampler(_multiplier, _chunkSize, taps);
+                std::vector<float> coeffs = filters::FIRcoeffcalc::calcCoeffs(dsp::filters::FIRcoeffcalc::lowpass, taps, 48000, 24000 * ((float)1 / multiplier));
+                interp = new interpolator<std::complex<float>>(coeffs, _multiplier, _chunkSize);
             }
 
             ~complexUpsampler() {
-                free(realInArr);
-                free(imagInArr);
-
-                free(realOutArr);
-                free(imagOutArr);
-
-                delete upReal;
-                delete upImag;
+                delete interp;
             }
 
             void processSamples(std::complex<float> *in, std::complex<float> *out) {
-                for (int i = 0; i < _chunkSize; i++) {
-                    realInArr[i] = in[i].real();
-                    imagInArr[i] = in[i].imag();
-                }
-                upReal->upsample(_chunkSize, realInArr, realOutArr);
-                upImag->upsample(_chunkSize, imagInArr, imagOutArr);
-                for (int i = 0; i < _chunkSize * _multiplier; i++) {
-                    out[i] = {realOutArr[i], imagOutArr[i]};
-                }
+                interp->process(in, out, _chunkSize);
             }
 
         private:
             int _chunkSize;
             int _multiplier;
-            float *realInArr;
-            float *imagInArr;
-            float *realOutArr;
-            float *imagOutArr;
-            resamplers::realUpsampler *upReal;
-            resamplers::realUpsampler *upImag;
+            interpolator<std::complex<float>> *interp;
         };
         class realDownsampler {
         public:
@@ -87,100 +604,62 @@ namespace dsp {
                 _divider = divider;
             }
 
-            ~realDownsampler() {}
+            // With anti-alias filter
+            realDownsampler(int chunkSize, int divider, int taps) {
+                _divider = divider;
+                std::vector<float> coeffs = filters::FIRcoeffcalc::calcCoeffs(dsp::filters::FIRcoeffcalc::lowpass, taps, 48000, 24000 * ((float)1 / divider));
+                for (size_t i = 0; i < coeffs.size(); i++) {
+                    coeffs[i] /= divider;
+                }
+                decim = new decimator<float>(coeffs, _divider, chunkSize);
+            }
+
+            ~realDownsampler() {
+                delete decim;
+            }
 
-            void downsample(int incount, float *in, float *out) {
+            // Returns the amount of output samples
+            int downsample(int incount, float *in, float *out) {
+                if (decim != nullptr) {
+                    return decim->process(in, out, incount);
+                }
                 for (int i = 0; i < incount; i += _divider) {
                     out[i / _divider] = in[i];
                 }
+                return (incount + _divider - 1) / _divider;
             }
 
         private:
             int _divider;
+            decimator<float> *decim = nullptr;
         };
 
         class PSK_PulseShaping_CCRationalResamplerBlock // satdump copypasted
         {
         public:
             PSK_PulseShaping_CCRationalResamplerBlock(int tapcount, unsigned int interpolation, float alpha, int maxInputSamples) {
-                unsigned int decimation = 1;
-                d_interpolation = interpolation;
-                d_decimation = decimation;
-
                 tapcount |= 1; // make sure tapcount is odd
 
-                float *tapsr = (float *)malloc(tapcount * sizeof(float));
-                filters::FIRcoeffcalc::root_raised_cosine(1, interpolation, decimation, alpha, tapcount, tapsr);
-
-                int align = volk_get_alignment();
-
-                // Buffer
-                in_buffer = 0;
-                int size = 2 * maxInputSamples;
-                buffer = (std::complex<float> *)volk_malloc(size * sizeof(std::complex<float>), align);
-                std::fill(buffer, &buffer[size], 0);
-
-                // Filter number & tap number
-                nfilt = d_interpolation;
-                ntaps = tapcount / nfilt;
-
-                // If Ntaps is slightly over 1, add 1 tap
-                if (fmod(double(tapcount) / double(nfilt), 1.0) > 0.0)
-                    ntaps++;
-
-                // Init tap buffers
-                taps = (float **)volk_malloc(nfilt * sizeof(float *), align);
-                for (int i = 0; i < nfilt; i++) {
-                    taps[i] = (float *)volk_malloc(ntaps * sizeof(float), align);
-                    memset(taps[i], 0, ntaps);
-                }
-
-                // Setup taps
-                for (int i = 0; i < tapcount; i++)
-                    taps[i % nfilt][(ntaps - 1) - (i / nfilt)] = tapsr[i];
+                std::vector<float> tapsr(tapcount);
+                filters::FIRcoeffcalc::root_raised_cosine(1, interpolation, 1, alpha, tapcount, tapsr.data());
 
-                free(tapsr);
+                interp = new interpolator<std::complex<float>>(tapsr, interpolation, maxInputSamples);
             }
 
             ~PSK_PulseShaping_CCRationalResamplerBlock() {
-                for (int i = 0; i < nfilt; i++)
-                    volk_free(taps[i]);
-                volk_free(taps);
-                volk_free(buffer);
+                delete interp;
             }
 
-            void process(std::complex<float> *input, std::complex<float> *output, int nsamples) {
-                memcpy(&buffer[ntaps], input, nsamples * sizeof(std::complex<float>));
-                in_buffer = ntaps + nsamples;
-
-                int outc = 0;
-                for (int i = 0; i < in_buffer - ntaps;) {
-                    volk_32fc_32f_dot_prod_32fc((lv_32fc_t *)&output[outc++], (lv_32fc_t *)&buffer[i], taps[d_ctr], ntaps);
-
-                    d_ctr += d_decimation;
-                    while (d_ctr >= d_interpolation) {
-                        d_ctr -= d_interpolation;
-                        i++;
-                    }
-                }
+            int calcOutSamples(int inCount) {
+                return interp->calcOutSamples(inCount);
+            }
 
-                memmove(&buffer[0], &buffer[in_buffer - ntaps], ntaps * sizeof(std::complex<float>));
+            void process(std::complex<float> *input, std::complex<float> *output, int nsamples) {
+                interp->process(input, output, nsamples);
             }
 
         private:
-            // Settings
-            int d_interpolation;
-            int d_decimation;
-            int d_ctr = 0;
-
-            // Buffer
-            std::complex<float> *buffer;
-            int in_buffer;
-
-            // Taps
-            float **taps;
-            int nfilt; // Number of filters (one per phase)
-            int ntaps;
+            interpolator<std::complex<float>> *interp;
         };
     }
 }
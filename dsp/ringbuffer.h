@@ -0,0 +1,75 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <volk/volk.h>
+
+namespace dsp::buffer {
+    // Lock-free ring buffer for exactly one writer thread and one reader thread. T has to be trivially copyable
+    template <class T>
+    class spscRingBuffer {
+    public:
+        // The capacity is rounded up to a power of two
+        spscRingBuffer(size_t capacity) {
+            size = 1;
+            while (size < capacity) {
+                size <<= 1;
+            }
+            mask = size - 1;
+            buffer = (T *)volk_malloc(size * sizeof(T), volk_get_alignment());
+        }
+
+        spscRingBuffer(const spscRingBuffer &) = delete;
+        spscRingBuffer &operator=(const spscRingBuffer &) = delete;
+
+        ~spscRingBuffer() {
+            volk_free(buffer);
+        }
+
+        size_t capacity() {
+            return size;
+        }
+
+        size_t readAvailable() {
+            return writeIndex.load(std::memory_order_acquire) - readIndex.load(std::memory_order_relaxed);
+        }
+
+        size_t writeAvailable() {
+            return size - (writeIndex.load(std::memory_order_relaxed) - readIndex.load(std::memory_order_acquire));
+        }
+
+        // Writer side, returns the amount of items actually written
+        size_t write(const T *data, size_t count) {
+            size_t w = writeIndex.load(std::memory_order_relaxed);
+            count = std::min(count, size - (w - readIndex.load(std::memory_order_acquire)));
+            size_t start = w & mask;
+            size_t first = std::min(count, size - start);
+            memcpy(&buffer[start], data, first * sizeof(T));
+            memcpy(buffer, &data[first], (count - first) * sizeof(T));
+            writeIndex.store(w + count, std::memory_order_release);
+            return count;
+        }
+
+        // Reader side, returns the amount of items actually read
+        size_t read(T *data, size_t count) {
+            size_t r = readIndex.load(std::memory_order_relaxed);
+            count = std::min(count, writeIndex.load(std::memory_order_acquire) - r);
+            size_t start = r & mask;
+            size_t first = std::min(count, size - start);
+            memcpy(data, &buffer[start], first * sizeof(T));
+            memcpy(&data[first], buffer, (count - first) * sizeof(T));
+            readIndex.store(r + count, std::memory_order_release);
+            return count;
+        }
+
+    private:
+        T *buffer;
+        size_t size;
+        size_t mask;
+
+        // Free running indices, kept on separate cache lines so the two threads don't fight over them
+        alignas(64) std::atomic<size_t> writeIndex = 0;
+        alignas(64) std::atomic<size_t> readIndex = 0;
+    };
+}
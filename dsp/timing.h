@@ -0,0 +1,161 @@
+#pragma once
+#include "firfilters.h"
+#include "instrumentation.h"
+#include "math.h"
+#include <algorithm>
+#include <complex>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+#include <volk/volk.h>
+
+namespace dsp::timing {
+    enum detector {
+        gardner,      // needs two samples per symbol, works without decisions
+        muellerMuller // one sample per symbol, decision directed (slices on the sign of I and Q)
+    };
+
+    // Symbol timing recovery with the RRC matched filter as a polyphase bank of nfilt phases (same tap layout as the interpolator used by
+    // PSK_PulseShaping_CCRationalResamplerBlock), the fractional part of the strobe position picks the nearest phase. That way the matched filter
+    // is only evaluated where a sample is needed instead of filtering every input sample and interpolating afterwards.
+    // tapcount is the RRC length at the input rate. The input should be at about unit amplitude, the loop gains assume a detector gain of 1
+    template <class T>
+    class symbolSync {
+    public:
+        symbolSync(detector ted, float samplesPerSymbol, float alpha, int tapcount, int nfilt, float loopBandwidth, int maxInputSamples, float damping = 0.707, float maxDeviation = 0.01) {
+            _ted = ted;
+            sps = samplesPerSymbol;
+            _nfilt = nfilt;
+            maxAdjust = maxDeviation * samplesPerSymbol;
+            setLoopBandwidth(loopBandwidth, damping);
+
+            int align = volk_get_alignment();
+
+            // Prototype at nfilt times the input rate, with a gain of nfilt every phase has unit DC gain
+            int prototypeTaps = (tapcount * _nfilt) | 1;
+            std::vector<float> taps(prototypeTaps);
+            filters::FIRcoeffcalc::root_raised_cosine(_nfilt, samplesPerSymbol * _nfilt, 1, alpha, prototypeTaps, taps.data());
+
+            ntaps = (prototypeTaps + _nfilt - 1) / _nfilt;
+            subtaps = (float *)volk_malloc(_nfilt * ntaps * sizeof(float), align);
+            std::fill(subtaps, &subtaps[_nfilt * ntaps], 0);
+            for (int i = 0; i < prototypeTaps; i++)
+                subtaps[((i % _nfilt) * ntaps) + (ntaps - 1) - (i / _nfilt)] = taps[i];
+
+            // Buffer, the history also covers the gardner midpoint half a symbol behind the strobe
+            history = (ntaps - 1) + (int)ceil(sps) + 2;
+            buffer = (T *)volk_malloc((maxInputSamples + history) * sizeof(T), align);
+            bufferStart = &buffer[history];
+            std::fill(buffer, &buffer[maxInputSamples + history], T(0));
+        }
+
+        ~symbolSync() {
+            volk_free(subtaps);
+            volk_free(buffer);
+        }
+
+        // PI loop filter, loopBandwidth is normalized to the symbol rate
+        void setLoopBandwidth(float loopBandwidth, float damping) {
+            double theta = loopBandwidth / (damping + (0.25 / damping));
+            double d = 1 + (2 * damping * theta) + (theta * theta);
+            kp = (4 * damping * theta) / d;
+            ki = (4 * theta * theta) / d;
+        }
+
+        // Upper bound
+        int calcOutSamples(int inCount) {
+            return (int)(inCount / (sps - maxAdjust)) + 2;
+        }
+
+        // Current symbol period in input samples
+        float getPeriod() {
+            return sps + periodAdjust;
+        }
+
+        // Returns the amount of symbols written
+        int process(T *in, T *out, int count) {
+            DSP_INSTRUMENT("timing::symbolSync", count);
+            memcpy(bufferStart, in, count * sizeof(T));
+            int outc = 0;
+            while (pos < count - 1) {
+                T sample = filterAt(pos);
+                T mid = _ted == gardner ? filterAt(pos - (getPeriod() / 2)) : T(0);
+
+                float error;
+                if (_ted == gardner) {
+                    error = real((lastSample - sample) * conj(mid));
+                } else {
+                    T decision = slice(sample);
+                    error = real((lastDecision * conj(sample)) - (decision * conj(lastSample)));
+                    lastDecision = decision;
+                }
+                lastSample = sample;
+                out[outc++] = sample;
+
+                integrator = std::clamp(integrator + (ki * error), -maxAdjust, maxAdjust);
+                periodAdjust = std::clamp(integrator + (kp * error), -maxAdjust, maxAdjust);
+                pos += sps + periodAdjust;
+            }
+            pos -= count;
+            memmove(buffer, &buffer[count], history * sizeof(T));
+            return outc;
+        }
+
+    private:
+        // Matched filter output at a fractional position relative to in[0], the newest sample used is in[floor(position)]
+        T filterAt(double position) {
+            int n = (int)floor(position);
+            int phase = (int)lrint((position - n) * _nfilt);
+            if (phase == _nfilt) {
+                n++;
+                phase = 0;
+            }
+            T res;
+            filters::dotProduct(&res, &bufferStart[n - (ntaps - 1)], &subtaps[phase * ntaps], ntaps);
+            return res;
+        }
+
+        static float real(T v) {
+            if constexpr (std::is_same_v<T, float>) {
+                return v;
+            } else {
+                return v.real();
+            }
+        }
+
+        static T conj(T v) {
+            if constexpr (std::is_same_v<T, float>) {
+                return v;
+            } else {
+                return std::conj(v);
+            }
+        }
+
+        static T slice(T v) {
+            if constexpr (std::is_same_v<T, float>) {
+                return v >= 0 ? 1.0f : -1.0f;
+            } else {
+                return T(v.real() >= 0 ? 1.0f : -1.0f, v.imag() >= 0 ? 1.0f : -1.0f);
+            }
+        }
+
+        detector _ted;
+        float sps;
+        int _nfilt;
+        float maxAdjust;
+        float kp;
+        float ki;
+
+        double pos = 0; // next strobe, in input samples relative to the start of the current block
+        float integrator = 0;
+        float periodAdjust = 0;
+        T lastSample = T(0);
+        T lastDecision = T(0);
+
+        int ntaps;
+        int history;
+        float *subtaps;
+        T *buffer;
+        T *bufferStart;
+    };
+}
@@ -1,32 +1,100 @@
 #pragma once
+#include "instrumentation.h"
 #include "math.h"
+#include "nco.h"
+#include <algorithm>
+#include <complex>
+#include <cstdint>
 
 namespace dsp::vco {
+    // Turns the control voltages into the phase of every sample (before its own increment is added). The increments are
+    // computed and wrapped in SIMD friendly loops, only the integer prefix sum is serial
+    inline void calcPhases(float *input, uint32_t *phases, int count, float speed, uint32_t &phase) {
+        int32_t increments[256];
+        for (int done = 0; done < count;) {
+            int n = std::min(count - done, 256);
+            for (int i = 0; i < n; i++) {
+                float turns = input[done + i] * speed;
+                turns -= rintf(turns);
+                increments[i] = (int32_t)(fminf(turns, 0.49999997f) * 4294967296.0f);
+            }
+            for (int i = 0; i < n; i++) {
+                phases[done + i] = phase;
+                phase += (uint32_t)increments[i];
+            }
+            done += n;
+        }
+    }
+
     class rvco {
     public:
         rvco() {}
 
         rvco(float basefreq, float samplerate) {
-            speed = ((FL_M_PI * 2) * basefreq) / samplerate;
+            changeBaseFreq(basefreq, samplerate);
         }
 
         ~rvco() {}
 
         void changeBaseFreq(float basefreq, float samplerate) {
-            speed = ((FL_M_PI * 2) * basefreq) / samplerate;
+            speed = basefreq / samplerate;
         }
 
+        // input and output may be the same array
         void process(float *input, float *output, int count) {
-            float in = 0; // this has been added to be able to use the same array as input and output
-            for (int i = 0; i < count; i++) {
-                in = input[i];
-                output[i] = sin(phase);
-                phase += in * speed;
+            DSP_INSTRUMENT("vco::rvco", count);
+            const float *table = nco::getSineTable();
+            for (int done = 0; done < count;) {
+                int n = std::min(count - done, chunkSize);
+                calcPhases(&input[done], phases, n, speed, phase);
+                for (int i = 0; i < n; i++) {
+                    output[done + i] = nco::lookupSin(table, phases[i]);
+                }
+                done += n;
+            }
+        }
+
+    private:
+        static constexpr int chunkSize = 1024;
+        uint32_t phase = 0;
+        uint32_t phases[chunkSize];
+        float speed = 0; // turns per sample at an input of 1
+    };
+
+    // e^(j * phase)
+    class cvco {
+    public:
+        cvco() {}
+
+        cvco(float basefreq, float samplerate) {
+            changeBaseFreq(basefreq, samplerate);
+        }
+
+        ~cvco() {}
+
+        void changeBaseFreq(float basefreq, float samplerate) {
+            speed = basefreq / samplerate;
+        }
+
+        void process(float *input, std::complex<float> *output, int count) {
+            DSP_INSTRUMENT("vco::cvco", count);
+            const float *table = nco::getSineTable();
+            float *outf = (float *)output;
+            for (int done = 0; done < count;) {
+                int n = std::min(count - done, chunkSize);
+                calcPhases(&input[done], phases, n, speed, phase);
+                for (int i = 0; i < n; i++) {
+                    outf[(done + i) * 2] = nco::lookupCos(table, phases[i]);
+                    outf[((done + i) * 2) + 1] = nco::lookupSin(table, phases[i]);
+                }
+                done += n;
             }
         }
 
     private:
-        float phase = 0;
-        float speed;
+        static constexpr int chunkSize = 1024;
+        uint32_t phase = 0;
+        uint32_t phases[chunkSize];
+        float speed = 0; // turns per sample at an input of 1
     };
 }
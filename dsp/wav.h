@@ -1,12 +1,26 @@
 #pragma once
+#include "convert.h"
+#include "ringbuffer.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
 #include <cstring>
 #include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <volk/volk.h>
 
 namespace dsp::wav {
     class wavWriter {
         // Epicly copied from https://github.com/AlexandreRouma/SDRPlusPlus/blob/master/misc_modules/recorder/src/wav.h
     public:
-        wavWriter(std::string path, uint16_t bitDepth, uint16_t channelCount, uint32_t sampleRate) {
+        // With rf64 space for a ds64 chunk is reserved, files that end up bigger than 4GB are turned into RF64 on finish()
+        wavWriter(std::string path, uint16_t bitDepth, uint16_t channelCount, uint32_t sampleRate, bool rf64 = false) {
+            _rf64 = rf64;
             outstream = std::ofstream(path.c_str(), std::ios::binary);
             header.formatHeaderLength = 16;
             header.sampleType = 1;
@@ -18,7 +32,10 @@ namespace dsp::wav {
             header.bytesPerSecond = sampleRate * channelCount * (bitDepth / 8);
             header.bytesPerSample = (bitDepth / 8) * channelCount;
             header.bitDepth = bitDepth;
-            outstream.write((char *)&header, sizeof(waveheader));
+            if (!convert::fromWavFormat(header.sampleType, header.bitDepth, fmt)) {
+                fmt = convert::f32;
+            }
+            writeHeader();
         }
 
         ~wavWriter() {
@@ -28,10 +45,25 @@ namespace dsp::wav {
         }
 
         void finish() {
-            header.fileSize = written + sizeof(waveheader) - 8;
-            header.dataSize = written;
+            uint64_t riffSize = written + headerSize() - 8;
+            if (_rf64 && riffSize > 0xFFFFFFFF) {
+                uint64_t sampleCount = written / header.bytesPerSample;
+                memcpy(header.signature, "RF64", 4);
+                header.fileSize = 0xFFFFFFFF;
+                header.dataSize = 0xFFFFFFFF;
+                memcpy(ds64.marker, "ds64", 4);
+                ds64.riffSizeLow = riffSize;
+                ds64.riffSizeHigh = riffSize >> 32;
+                ds64.dataSizeLow = written;
+                ds64.dataSizeHigh = (uint64_t)written >> 32;
+                ds64.sampleCountLow = sampleCount;
+                ds64.sampleCountHigh = sampleCount >> 32;
+            } else {
+                header.fileSize = std::min(riffSize, (uint64_t)0xFFFFFFFF);
+                header.dataSize = std::min((uint64_t)written, (uint64_t)0xFFFFFFFF);
+            }
             outstream.seekp(0);
-            outstream.write((char *)&header, sizeof(waveheader));
+            writeHeader();
             outstream.close();
         }
 
@@ -44,7 +76,47 @@ namespace dsp::wav {
             written += size;
         }
 
+        // Converts count values to the file's sample format
+        void writeFloat(float *samples, size_t count) {
+            if (fmt == convert::f32) {
+                writeData(samples, count * sizeof(float));
+                return;
+            }
+            convertBuffer.resize(count * convert::bytesPerValue(fmt));
+            convert::fromFloat(fmt, samples, convertBuffer.data(), count);
+            writeData(convertBuffer.data(), convertBuffer.size());
+        }
+
+        convert::format getFormat() {
+            return fmt;
+        }
+
     private:
+        size_t headerSize() {
+            return sizeof(waveheader) + (_rf64 ? sizeof(ds64chunk) : 0);
+        }
+
+        void writeHeader() {
+            outstream.write((char *)&header, offsetof(waveheader, formatMarker));
+            if (_rf64) {
+                outstream.write((char *)&ds64, sizeof(ds64chunk));
+            }
+            outstream.write(header.formatMarker, sizeof(waveheader) - offsetof(waveheader, formatMarker));
+        }
+
+        // Written as JUNK (which readers skip) and only turned into ds64 if needed
+        struct ds64chunk {
+            char marker[4] = {'J', 'U', 'N', 'K'};
+            uint32_t chunkSize = 28;
+            uint32_t riffSizeLow = 0;
+            uint32_t riffSizeHigh = 0;
+            uint32_t dataSizeLow = 0;
+            uint32_t dataSizeHigh = 0;
+            uint32_t sampleCountLow = 0;
+            uint32_t sampleCountHigh = 0;
+            uint32_t tableLength = 0;
+        };
+
         struct waveheader {
             char signature[4] = {'R', 'I', 'F', 'F'};
             uint32_t fileSize;
@@ -62,10 +134,225 @@ namespace dsp::wav {
         };
 
         waveheader header;
+        ds64chunk ds64;
+        bool _rf64;
+        convert::format fmt;
+        std::vector<uint8_t> convertBuffer;
         std::ofstream outstream;
         size_t written = 0;
     };
 
+    // Writes from a background thread. The DSP thread fills preallocated buffers and hands them off in O(1), the I/O thread writes them out whole
+    class asyncWavWriter {
+    public:
+        struct stats {
+            size_t queueDepth;    // filled buffers waiting to be written
+            size_t maxQueueDepth;
+            uint64_t stallCount;  // times the DSP thread had to wait for a free buffer
+            uint64_t stallTimeNs; // total time spent waiting
+            uint64_t bytesWritten;
+        };
+
+        asyncWavWriter(std::string path, uint16_t bitDepth, uint16_t channelCount, uint32_t sampleRate, size_t bufferSize = 1 << 20, int bufferCount = 8, bool rf64 = false)
+            : writer(path, bitDepth, channelCount, sampleRate, rf64), freeBuffers(bufferCount), filledBuffers(bufferCount) {
+            // Page aligned and a multiple of the page size, so every full buffer goes out as one large aligned write
+            _bufferSize = (bufferSize + pageSize - 1) & ~(pageSize - 1);
+            fillSizes.resize(bufferCount);
+            for (int i = 0; i < bufferCount; i++) {
+                uint8_t *buf = (uint8_t *)volk_malloc(_bufferSize, pageSize);
+                if (buf == nullptr) {
+                    return; // isOpen() reports the failure, nothing is started
+                }
+                buffers.push_back(buf);
+                freeBuffers.write(&i, 1);
+            }
+            ioThread = std::thread(&asyncWavWriter::ioWorker, this);
+        }
+
+        ~asyncWavWriter() {
+            finish();
+            for (uint8_t *buf : buffers) {
+                volk_free(buf);
+            }
+        }
+
+        bool isOpen() {
+            return writer.isOpen() && ioThread.joinable();
+        }
+
+        size_t getBufferSize() {
+            return _bufferSize;
+        }
+
+        // Buffer for the caller to fill directly, hand it off with submitBuffer(). Blocks (and counts a stall) if all buffers are queued, nullptr if not open
+        uint8_t *getBuffer() {
+            if (!isOpen()) {
+                return nullptr;
+            }
+            if (current >= 0 && currentFill > 0) {
+                submitBuffer(currentFill);
+            }
+            if (current < 0) {
+                current = acquire();
+            }
+            return buffers[current];
+        }
+
+        void submitBuffer(size_t size) {
+            fillSizes[current] = size;
+            filledBuffers.write(&current, 1);
+            current = -1;
+            currentFill = 0;
+            maxQueueDepth = std::max(maxQueueDepth.load(std::memory_order_relaxed), filledBuffers.readAvailable());
+            notifyIO();
+        }
+
+        // Same as wavWriter::writeData, copies into the current buffer and submits it once full
+        void writeData(void *data, size_t size) {
+            if (!isOpen()) {
+                return;
+            }
+            uint8_t *src = (uint8_t *)data;
+            while (size > 0) {
+                if (current < 0) {
+                    current = acquire();
+                }
+                size_t n = std::min(size, _bufferSize - currentFill);
+                memcpy(&buffers[current][currentFill], src, n);
+                currentFill += n;
+                src += n;
+                size -= n;
+                if (currentFill == _bufferSize) {
+                    submitBuffer(currentFill);
+                }
+            }
+        }
+
+        // Converts count values to the file's sample format straight into the pool buffers
+        void writeFloat(float *samples, size_t count) {
+            if (!isOpen()) {
+                return;
+            }
+            convert::format fmt = writer.getFormat();
+            size_t valueSize = convert::bytesPerValue(fmt);
+            while (count > 0) {
+                if (current < 0) {
+                    current = acquire();
+                }
+                size_t n = std::min(count, (_bufferSize - currentFill) / valueSize);
+                convert::fromFloat(fmt, samples, &buffers[current][currentFill], n);
+                currentFill += n * valueSize;
+                samples += n;
+                count -= n;
+                if (_bufferSize - currentFill < valueSize) {
+                    submitBuffer(currentFill);
+                }
+            }
+        }
+
+        // Flushes everything, stops the I/O thread and finalizes the header. Calling it again does nothing
+        void finish() {
+            if (finished || !ioThread.joinable()) {
+                return;
+            }
+            if (current >= 0) {
+                if (currentFill > 0) {
+                    submitBuffer(currentFill);
+                } else {
+                    freeBuffers.write(&current, 1);
+                    current = -1;
+                }
+            }
+            running = false;
+            notifyIO();
+            ioThread.join();
+            writer.finish();
+            finished = true;
+        }
+
+        stats getStats() {
+            stats s;
+            s.queueDepth = filledBuffers.readAvailable();
+            s.maxQueueDepth = maxQueueDepth.load(std::memory_order_relaxed);
+            s.stallCount = stallCount.load(std::memory_order_relaxed);
+            s.stallTimeNs = stallTimeNs.load(std::memory_order_relaxed);
+            s.bytesWritten = bytesWritten.load(std::memory_order_relaxed);
+            return s;
+        }
+
+    private:
+        // Taking the lock makes sure the I/O thread can't miss the wakeup between checking the queue and waiting
+        void notifyIO() {
+            {
+                std::lock_guard<std::mutex> lck(ioMtx);
+            }
+            ioCnd.notify_one();
+        }
+
+        int acquire() {
+            int idx;
+            if (freeBuffers.read(&idx, 1) == 1) {
+                return idx;
+            }
+            auto start = std::chrono::steady_clock::now();
+            {
+                std::unique_lock<std::mutex> lck(freeMtx);
+                freeCnd.wait(lck, [&] { return freeBuffers.read(&idx, 1) == 1; });
+            }
+            stallCount++;
+            stallTimeNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            return idx;
+        }
+
+        void ioWorker() {
+            while (true) {
+                int idx;
+                if (filledBuffers.read(&idx, 1) == 1) {
+                    writer.writeData(buffers[idx], fillSizes[idx]);
+                    bytesWritten += fillSizes[idx];
+                    freeBuffers.write(&idx, 1);
+                    {
+                        // Taking the lock makes sure a waiting DSP thread can't miss the wakeup
+                        std::lock_guard<std::mutex> lck(freeMtx);
+                    }
+                    freeCnd.notify_one();
+                    continue;
+                }
+                if (!running && filledBuffers.readAvailable() == 0) {
+                    break;
+                }
+                std::unique_lock<std::mutex> lck(ioMtx);
+                ioCnd.wait(lck, [&] { return filledBuffers.readAvailable() > 0 || !running; });
+            }
+        }
+
+        wavWriter writer;
+        size_t _bufferSize;
+        static constexpr size_t pageSize = 4096;
+        std::vector<uint8_t *> buffers;
+        std::vector<size_t> fillSizes;
+
+        buffer::spscRingBuffer<int> freeBuffers;   // I/O thread -> DSP thread
+        buffer::spscRingBuffer<int> filledBuffers; // DSP thread -> I/O thread
+
+        // DSP thread only
+        int current = -1;
+        size_t currentFill = 0;
+        bool finished = false;
+
+        std::thread ioThread;
+        std::atomic<bool> running = true;
+        std::mutex ioMtx;
+        std::condition_variable ioCnd;
+        std::mutex freeMtx;
+        std::condition_variable freeCnd;
+
+        std::atomic<size_t> maxQueueDepth = 0;
+        std::atomic<uint64_t> stallCount = 0;
+        std::atomic<uint64_t> stallTimeNs = 0;
+        std::atomic<uint64_t> bytesWritten = 0;
+    };
+
     class wavReader {
         // https://github.com/AlexandreRouma/SDRPlusPlus/blob/master/source_modules/file_source/src/wavreader.h
     public:
@@ -128,23 +415,19 @@ namespace dsp::wav {
         }
 
         bool readFloat(float *samples, unsigned long samplecount) {
-            // float
-            if (header.bitDepth == 32 && header.sampleType == 3) {
-                readRaw((void *)samples, samplecount * sizeof(float));
-                return true;
+            convert::format fmt;
+            if (!convert::fromWavFormat(header.sampleType, header.bitDepth, fmt)) {
+                return false;
             }
-
-            // 16-bit signed integer
-            if (header.bitDepth == 16 && header.sampleType == 1) {
-                int16_t *buffer = (int16_t *)malloc(samplecount * sizeof(int16_t));
-                readRaw((void *)buffer, samplecount * sizeof(int16_t));
-                for (unsigned long i = 0; i < samplecount; i++) {
-                    samples[i] = buffer[i] / 32767.0f;
-                }
-                free(buffer);
+            if (fmt == convert::f32) {
+                readRaw((void *)samples, samplecount * sizeof(float));
                 return true;
             }
-            return false;
+            // Kept around so repeated reads don't allocate
+            convertBuffer.resize(samplecount * convert::bytesPerValue(fmt));
+            readRaw((void *)convertBuffer.data(), convertBuffer.size());
+            convert::toFloat(fmt, convertBuffer.data(), samples, samplecount);
+            return true;
         }
 
     private:
@@ -166,6 +449,7 @@ namespace dsp::wav {
 
         std::ifstream instream;
         waveheader header;
+        std::vector<uint8_t> convertBuffer;
         bool headerValid = false;
         uint64_t actualSampleCount = 0;
     };
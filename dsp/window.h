@@ -9,5 +9,25 @@ namespace dsp {
             double a2 = alpha / 2.0f;
             return a0 - (0.5f * cos(2.0f * FL_M_PI * (n / N))) + (a2 * cos(4.0f * FL_M_PI * (n / N)));
         }
+
+        // Modified bessel function of the first kind, order 0
+        inline double besselI0(double x) {
+            double sum = 1;
+            double term = 1;
+            for (int k = 1; k < 64; k++) {
+                term *= (x / (2 * k)) * (x / (2 * k));
+                sum += term;
+                if (term < sum * 1e-17) {
+                    break;
+                }
+            }
+            return sum;
+        }
+
+        // Same n / N convention as blackman, beta trades main lobe width against sidelobe level
+        inline double kaiser(double n, double N, double beta) {
+            double r = ((2 * n) / N) - 1;
+            return besselI0(beta * sqrt(fmax(0, 1 - (r * r)))) / besselI0(beta);
+        }
     }
 }